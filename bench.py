@@ -0,0 +1,150 @@
+import os
+import re
+import json
+import argparse
+import subprocess
+import datetime
+from tempfile import NamedTemporaryFile
+
+from test import Test, red, green, box
+
+### Settings ###
+
+TIMEOUT = 60
+RVSIM_PATH = "./rvsim"
+THRESHOLD = 2.0  # percent a kernel may get worse by before --compare fails
+BENCH_PATH = "tests/bench"
+# the compute-heavy programs of lab4 run alongside the kernels of tests/bench
+LAB4_KERNELS = ["sudoku.sy", "quick_sort.sy", "merge_sort.sy", "binary_search.sy"]
+METRICS = ["instructions", "cycles"]
+
+### Bench Utils ###
+
+
+def kernels() -> list[Test]:
+    files = [f"tests/lab4/{name}" for name in LAB4_KERNELS]
+    files += sorted(f"{BENCH_PATH}/{name}" for name in os.listdir(BENCH_PATH) if name.endswith(".sy"))
+    return [Test.parse_file(filename) for filename in files]
+
+
+def run_kernel(compiler: str, flags: list[str], test: Test) -> dict | None:
+    assembly_file = NamedTemporaryFile(suffix=".s")
+    try:
+        result = subprocess.run(
+            [compiler, *flags, test.filename, assembly_file.name],
+            capture_output=True,
+            timeout=TIMEOUT)
+        if result.returncode != 0:
+            print(red(f"Error: {test.filename} failed to compile."))
+            return None
+        input = "\n".join(test.inputs) if test.inputs is not None else ""
+        result = subprocess.run(
+            [RVSIM_PATH, "--stats", assembly_file.name],
+            input=input,
+            capture_output=True,
+            text=True,
+            timeout=TIMEOUT)
+    except subprocess.TimeoutExpired:
+        print(red(f"Error: {test.filename} timed out."))
+        return None
+    output = result.stdout.strip().split("\n")[0]
+    if result.returncode != 0 or output != "".join(test.expected):
+        print(red(f"Error: {test.filename} gave a wrong answer."))
+        return None
+    # the --stats report has one "<metric>  <count> ..." line per metric
+    stats = {}
+    for metric in METRICS:
+        match = re.search(rf"^{metric}\s+(\d+)", result.stderr, re.MULTILINE)
+        assert match is not None, f"Error: {RVSIM_PATH} did not report {metric}."
+        stats[metric] = int(match.group(1))
+    return stats
+
+
+def run_suite(compiler: str, flags: list[str]) -> dict:
+    print(box("Running benchmarks..."))
+    report = {
+        "compiler": compiler,
+        "flags": flags,
+        "date": datetime.datetime.now().strftime("%Y-%m-%d %H:%M:%S"),
+        "kernels": {},
+    }
+    tests = kernels()
+    max_filename = max(len(test.filename) for test in tests)
+    for test in tests:
+        stats = run_kernel(compiler, flags, test)
+        name = os.path.basename(test.filename).removesuffix(".sy")
+        report["kernels"][name] = stats
+        print(f"{test.filename.ljust(max_filename)}  ", end="")
+        if stats is None:
+            print(red("FAILED"))
+        else:
+            print("  ".join(f"{stats[metric]:>12}" for metric in METRICS))
+    return report
+
+
+def compare(baseline: dict, report: dict, threshold: float) -> bool:
+    print()
+    print(box(f"Comparing with the baseline of {baseline['date']}..."))
+    names = [name for name in report["kernels"] if name in baseline["kernels"]]
+    max_name = max(len(name) for name in names) if names else 0
+    ok = True
+    for name in names:
+        old, new = baseline["kernels"][name], report["kernels"][name]
+        print(f"{name.ljust(max_name)}  ", end="")
+        if new is None or old is None:
+            ok = ok and new is not None
+            print(red("FAILED") if new is None else "no baseline")
+            continue
+        changes = []
+        for metric in METRICS:
+            change = (new[metric] - old[metric]) * 100 / old[metric]
+            text = f"{metric} {change:+7.2f}%"
+            if change > threshold:
+                ok = False
+                text = red(text)
+            elif change < 0:
+                text = green(text)
+            changes.append(text)
+        print("  ".join(changes))
+    missing = [name for name in baseline["kernels"] if name not in report["kernels"]]
+    for name in missing:
+        print(f"{name} is in the baseline but was not run.")
+    print()
+    if ok:
+        print(green(f"No kernel regressed by more than {threshold}%."))
+    else:
+        print(red(f"Some kernel regressed by more than {threshold}%."))
+    return ok
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Benchmark the code your compiler generates.")
+    parser.add_argument("input_file", type=str, help="Your complier file")
+    parser.add_argument("--rvsim", type=str, metavar="PATH", default=RVSIM_PATH,
+                        help=f"The native RISC-V simulator to count with (default {RVSIM_PATH}).")
+    parser.add_argument("--flags", type=str, default="",
+                        help="Extra options passed to the compiler, e.g. \"--profile-use=prof\".")
+    parser.add_argument("-o", "--output", type=str, metavar="JSON",
+                        help="Write the report to JSON.")
+    parser.add_argument("--compare", type=str, metavar="JSON",
+                        help="Compare with a report written earlier and fail on regressions.")
+    parser.add_argument("--threshold", type=float, default=THRESHOLD, metavar="PCT",
+                        help=f"Percentage a kernel may regress by under --compare (default {THRESHOLD}).")
+    args = parser.parse_args()
+    RVSIM_PATH = args.rvsim
+    if not os.path.exists(args.input_file):
+        print(f"File {args.input_file} not found.")
+        exit(1)
+    assert os.path.exists(RVSIM_PATH), f"Error: {RVSIM_PATH} not found."
+    report = run_suite(args.input_file, args.flags.split())
+    if args.output is not None:
+        with open(args.output, "w") as f:
+            json.dump(report, f, indent=2)
+    failed = [name for name, stats in report["kernels"].items() if stats is None]
+    if args.compare is not None:
+        with open(args.compare) as f:
+            baseline = json.load(f)
+        if not compare(baseline, report, args.threshold):
+            exit(1)
+    if failed:
+        exit(1)
@@ -37,6 +37,7 @@ class RelOp(Op):
 class UnOp(Op):
     Neg = "-"
     Pos = "+"
+    Not = "!"
 
 
 @dataclass
@@ -302,6 +303,18 @@ class Fillw(IRNode):
     def __str__(self) -> str:
         return f".word #{self.value}"
 
+@dataclass
+class Fillz(IRNode):
+    """ Fill zero bytes to current address """
+
+    size: int
+
+    def __init__(self, token):
+        self.size = int(token.value)
+
+    def __str__(self) -> str:
+        return f".zero #{self.size}"
+
 class ToIR(Transformer):
     def start(self, args): return args
     def mul(self, _): return BinOp.Mul
@@ -317,6 +330,7 @@ class ToIR(Transformer):
     def ne(self, _): return RelOp.Ne
     def neg(self, _): return UnOp.Neg
     def pos(self, _): return UnOp.Pos
+    def lnot(self, _): return UnOp.Not
 
 # -------------------------------- Parser --------------------------------#
 
@@ -332,7 +346,9 @@ start: instruction*
     | "*" NAME "=" NAME -> store
     | NAME "=" "*" NAME -> deref
     | NAME "=" NAME binop NAME -> binary
+    | NAME "=" NAME relop NAME -> binary
     | NAME "=" NAME binop "#" SIGNED_INT -> binaryi
+    | NAME "=" NAME relop "#" SIGNED_INT -> binaryi
     | NAME "=" "#" SIGNED_INT -> li
     | "PARAM" NAME -> param
     | "ARG" NAME -> arg
@@ -345,6 +361,7 @@ start: instruction*
     | NAME "=" "&" NAME -> la
     | "GLOBAL" NAME ":" -> global
     | ".WORD" "#" SIGNED_INT -> fillw
+    | ".ZERO" "#" SIGNED_INT -> fillz
 
 ?relop : "<" -> lt
     | ">" -> gt
@@ -361,6 +378,7 @@ start: instruction*
 
 ?unop : "-" -> neg
     | "+" -> pos
+    | "!" -> lnot
     
 %import python.NAME
 %import common.SIGNED_INT
@@ -483,6 +501,7 @@ op2func = {
     # unary op
     UnOp.Neg: lambda x: -x,
     UnOp.Pos: lambda x: x,
+    UnOp.Not: lambda x: int(x == 0),
 }
 
 
@@ -515,13 +534,13 @@ class FunctionFrame:
             match ir:
                 case Binary(dst, left, op, right):
                     if op in op2func.keys():
-                        env[dst] = op2func[op](env[left], env[right])
+                        env[dst] = int(op2func[op](env[left], env[right]))
                     else:
                         raise NotImplementedError(
                             f"{op} is not implemented.")
                 case Binaryi(dst, left, op, right):
                     if op in op2func.keys():
-                        env[dst] = op2func[op](env[left], right)
+                        env[dst] = int(op2func[op](env[left], right))
                     else:
                         raise NotImplementedError(
                             f"{op} is not implemented.")
@@ -628,6 +647,10 @@ def build_function(irs: list[IRNode]) -> list[FunctionFrame]:
             if current_var is None:
                 raise SyntaxError("No global variable to fill")
             global_var[current_var].append(ir.value)
+        elif isinstance(ir, Fillz):
+            if current_var is None:
+                raise SyntaxError("No global variable to fill")
+            global_var[current_var].extend([0] * (ir.size // 4))
         else:
             frames[-1].add_code(ir)
     for name, values in global_var.items():
@@ -1,6 +1,7 @@
 #include "assembly.h"
 #include <string.h>
 #include <cstdarg>
+#include <unordered_map>
 
 extern FILE* outputFile;
 
@@ -16,47 +17,31 @@ static void printToFile(FILE* file, const char* format, ...) {
 }
 
 void BinaryAssembly::print() {
-    switch (op[0]) {
-        case '+':
-            printToFile(outputFile, "add %s, %s, %s\n", lhs.name.c_str(), rhs1.name.c_str(), rhs2.name.c_str());
-            break;
-        case '-':
-            printToFile(outputFile, "sub %s, %s, %s\n", lhs.name.c_str(), rhs1.name.c_str(), rhs2.name.c_str());
-            break;
-        case '*':
-            printToFile(outputFile, "mul %s, %s, %s\n", lhs.name.c_str(), rhs1.name.c_str(), rhs2.name.c_str());
-            break;
-        case '/':
-            printToFile(outputFile, "div %s, %s, %s\n", lhs.name.c_str(), rhs1.name.c_str(), rhs2.name.c_str());
-            break;
-        case '%':
-            printToFile(outputFile, "rem %s, %s, %s\n", lhs.name.c_str(), rhs1.name.c_str(), rhs2.name.c_str());
-            break;
-        default:
-            throw std::runtime_error("Invalid binary operator");
+    static const std::unordered_map<std::string, std::string> mnemonics = {
+        {"+", "add"}, {"-", "sub"}, {"*", "mul"}, {"mulh", "mulh"}, {"/", "div"}, {"%", "rem"}};
+    auto it = mnemonics.find(op);
+    if (it == mnemonics.end()) {
+        throw std::runtime_error("Invalid binary operator");
     }
+    printToFile(outputFile, "%s %s, %s, %s\n", it->second.c_str(), lhs.name.c_str(), rhs1.name.c_str(),
+                rhs2.name.c_str());
 }
 
+void CompareAssembly::print() {
+    printToFile(outputFile, "%s %s, %s, %s\n", op.c_str(), lhs.name.c_str(), rhs1.name.c_str(), rhs2.name.c_str());
+}
+
+void SetAssembly::print() { printToFile(outputFile, "%s %s, %s\n", op.c_str(), lhs.name.c_str(), rhs.name.c_str()); }
+
 void BinaryImmAssembly::print() {
-    switch (op[0]) {
-        case '+':
-            printToFile(outputFile, "addi %s, %s, %d\n", lhs.name.c_str(), rhs.name.c_str(), imm.value);
-            break;
-        case '-':
-            printToFile(outputFile, "subi %s, %s, %d\n", lhs.name.c_str(), rhs.name.c_str(), imm.value);
-            break;
-        case '*':
-            printToFile(outputFile, "muli %s, %s, %d\n", lhs.name.c_str(), rhs.name.c_str(), imm.value);
-            break;
-        case '/':
-            printToFile(outputFile, "divi %s, %s, %d\n", lhs.name.c_str(), rhs.name.c_str(), imm.value);
-            break;
-        case '%':
-            printToFile(outputFile, "remi %s, %s, %d\n", lhs.name.c_str(), rhs.name.c_str(), imm.value);
-            break;
-        default:
-            throw std::runtime_error("Invalid binary operator");
+    static const std::unordered_map<std::string, std::string> mnemonics = {
+        {"+", "addi"}, {"^", "xori"}, {"&", "andi"}, {"|", "ori"},
+        {"<", "slti"}, {"<<", "slli"}, {">>", "srai"}, {">>>", "srli"}};
+    auto it = mnemonics.find(op);
+    if (it == mnemonics.end()) {
+        throw std::runtime_error("Invalid binary operator");
     }
+    printToFile(outputFile, "%s %s, %s, %d\n", it->second.c_str(), lhs.name.c_str(), rhs.name.c_str(), imm.value);
 }
 
 void Mv::print() { printToFile(outputFile, "mv %s, %s\n", lhs.name.c_str(), rhs.name.c_str()); }
@@ -76,32 +61,35 @@ void Lw::print() { printToFile(outputFile, "lw %s, %d(%s)\n", lhs.name.c_str(),
 void Sw::print() { printToFile(outputFile, "sw %s, %d(%s)\n", lhs.name.c_str(), offset, rhs.name.c_str()); }
 
 void Branch::print() {
-    switch (op[0]) {
-        case '>':
-            if (op.length() == 1) {
-                printToFile(outputFile, "bgt %s, %s, %s\n", lhs.name.c_str(), rhs.name.c_str(), label.ident.c_str());
-            } else {
-                printToFile(outputFile, "bge %s, %s, %s\n", lhs.name.c_str(), rhs.name.c_str(), label.ident.c_str());
-            }
-            break;
-        case '<':
-            if (op.length() == 1) {
-                printToFile(outputFile, "blt %s, %s, %s\n", lhs.name.c_str(), rhs.name.c_str(), label.ident.c_str());
-            } else {
-                printToFile(outputFile, "ble %s, %s, %s\n", lhs.name.c_str(), rhs.name.c_str(), label.ident.c_str());
-            }
-            break;
-        case '=':
-            printToFile(outputFile, "beq %s, %s, %s\n", lhs.name.c_str(), rhs.name.c_str(), label.ident.c_str());
-            break;
-        case '!':
-            printToFile(outputFile, "bne %s, %s, %s\n", lhs.name.c_str(), rhs.name.c_str(), label.ident.c_str());
-            break;
-        default:
-            throw std::runtime_error("Invalid branch operator");
+    static const std::unordered_map<std::string, std::string> mnemonics = {
+        {">", "bgt"}, {">=", "bge"}, {"<", "blt"}, {"<=", "ble"}, {"==", "beq"}, {"!=", "bne"}};
+    auto it = mnemonics.find(op);
+    if (it == mnemonics.end()) {
+        throw std::runtime_error("Invalid branch operator");
+    }
+    // compare with x0 by the zero forms, e.g. beqz
+    if (rhs.index == 0) {
+        printToFile(outputFile, "%sz %s, %s\n", it->second.c_str(), lhs.name.c_str(), label.ident.c_str());
+    } else if (lhs.index == 0) {
+        static const std::unordered_map<std::string, std::string> swapped = {
+            {"bgt", "bltz"}, {"bge", "blez"}, {"blt", "bgtz"}, {"ble", "bgez"}, {"beq", "beqz"}, {"bne", "bnez"}};
+        printToFile(outputFile, "%s %s, %s\n", swapped.at(it->second).c_str(), rhs.name.c_str(), label.ident.c_str());
+    } else {
+        printToFile(outputFile, "%s %s, %s, %s\n", it->second.c_str(), lhs.name.c_str(), rhs.name.c_str(),
+                    label.ident.c_str());
     }
 }
 
 void La::print() { printToFile(outputFile, "la %s, %s\n", lhs.name.c_str(), ident.ident.c_str()); }
 
-void WordAssembly::print() { printToFile(outputFile, ".word %d\n", val.value); }
\ No newline at end of file
+void WordAssembly::print() {
+    std::string line = ".word ";
+    for (auto i = 0ull; i < vals.size(); ++i) {
+        line += (i ? ", " : "") + std::to_string(vals[i].value);
+    }
+    printToFile(outputFile, "%s\n", line.c_str());
+}
+
+void SpaceAssembly::print() { printToFile(outputFile, ".space %d\n", size.value); }
+
+void TextAssembly::print() { fputs(text.c_str(), outputFile); }
\ No newline at end of file
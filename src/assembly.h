@@ -4,6 +4,8 @@
 #include "common.h"
 #include <string>
 #include <stdexcept>
+#include <unordered_map>
+#include <vector>
 
 class AssemblyNode {
    public:
@@ -15,6 +17,12 @@ class AssemblyNode {
     }
 
     virtual void print() { throw "AssemblyNode::print() not implemented!"; }
+    // for scheduling: registers written and read, and the kind of instruction; a barrier ends a basic block
+    virtual std::vector<int> defs() const { return {}; }
+    virtual std::vector<int> uses() const { return {}; }
+    virtual std::string kind() const { return "barrier"; }
+    // for the peephole pass: write the result to another register
+    virtual void renameDef(int reg) { throw std::runtime_error("AssemblyNode::renameDef() not implemented"); }
     AssemblyNode *next = nullptr;
 };
 
@@ -32,6 +40,9 @@ class ImmAssembly {
     int value;
 };
 
+// whether the value fits in the 12-bit signed immediate of I-type instructions
+inline bool isImm12(long long value) { return value >= -2048 && value < 2048; }
+
 class IdentAssembly {
    public:
     IdentAssembly(std::string ident) : ident(ident) {}
@@ -43,17 +54,63 @@ class BinaryAssembly : public AssemblyNode {
     BinaryAssembly(Register lhs, Register rhs1, Register rhs2, std::string op)
         : lhs(lhs), rhs1(rhs1), rhs2(rhs2), op(op) {}
     void print() override;
+    std::vector<int> defs() const override { return {lhs.index}; }
+    std::vector<int> uses() const override { return {rhs1.index, rhs2.index}; }
+    std::string kind() const override {
+        return op == "*" || op == "mulh" ? "mul" : op == "/" || op == "%" ? "div" : "alu";
+    }
+    void renameDef(int reg) override { lhs = Register(reg); }
+    std::string getOp() const { return op; }
+
+   private:
+    Register lhs, rhs1, rhs2;
+    std::string op;
+};
+
+// slt and xor
+class CompareAssembly : public AssemblyNode {
+   public:
+    CompareAssembly(Register lhs, Register rhs1, Register rhs2, std::string op)
+        : lhs(lhs), rhs1(rhs1), rhs2(rhs2), op(op) {}
+    void print() override;
+    std::vector<int> defs() const override { return {lhs.index}; }
+    std::vector<int> uses() const override { return {rhs1.index, rhs2.index}; }
+    std::string kind() const override { return "alu"; }
+    void renameDef(int reg) override { lhs = Register(reg); }
 
    private:
     Register lhs, rhs1, rhs2;
     std::string op;
 };
 
+// seqz, snez
+class SetAssembly : public AssemblyNode {
+   public:
+    SetAssembly(Register lhs, Register rhs, std::string op) : lhs(lhs), rhs(rhs), op(op) {}
+    void print() override;
+    std::vector<int> defs() const override { return {lhs.index}; }
+    std::vector<int> uses() const override { return {rhs.index}; }
+    std::string kind() const override { return "alu"; }
+    void renameDef(int reg) override { lhs = Register(reg); }
+
+   private:
+    Register lhs, rhs;
+    std::string op;
+};
+
 class BinaryImmAssembly : public AssemblyNode {
    public:
     BinaryImmAssembly(Register lhs, Register rhs, ImmAssembly imm, std::string op)
         : lhs(lhs), rhs(rhs), imm(imm), op(op) {}
     void print() override;
+    std::vector<int> defs() const override { return {lhs.index}; }
+    std::vector<int> uses() const override { return {rhs.index}; }
+    std::string kind() const override { return "alu"; }
+    void renameDef(int reg) override { lhs = Register(reg); }
+    int getLhs() const { return lhs.index; }
+    int getRhs() const { return rhs.index; }
+    int getImm() const { return imm.value; }
+    std::string getOp() const { return op; }
 
    private:
     Register lhs, rhs;
@@ -65,6 +122,12 @@ class Mv : public AssemblyNode {
    public:
     Mv(Register lhs, Register rhs) : lhs(lhs), rhs(rhs) {}
     void print() override;
+    std::vector<int> defs() const override { return {lhs.index}; }
+    std::vector<int> uses() const override { return {rhs.index}; }
+    std::string kind() const override { return "alu"; }
+    void renameDef(int reg) override { lhs = Register(reg); }
+    int getLhs() const { return lhs.index; }
+    int getRhs() const { return rhs.index; }
 
    private:
     Register lhs, rhs;
@@ -74,6 +137,11 @@ class Li : public AssemblyNode {
    public:
     Li(Register lhs, ImmAssembly imm) : lhs(lhs), imm(imm) {}
     void print() override;
+    std::vector<int> defs() const override { return {lhs.index}; }
+    std::string kind() const override { return "alu"; }
+    void renameDef(int reg) override { lhs = Register(reg); }
+    int getLhs() const { return lhs.index; }
+    int getImm() const { return imm.value; }
 
    private:
     Register lhs;
@@ -84,6 +152,7 @@ class LabelAssembly : public AssemblyNode {
    public:
     LabelAssembly(IdentAssembly label) : label(label) {}
     void print() override;
+    std::string getLabel() const { return label.ident; }
 
    private:
     IdentAssembly label;
@@ -93,6 +162,7 @@ class J : public AssemblyNode {
    public:
     J(IdentAssembly label) : label(label) {}
     void print() override;
+    std::string getLabel() const { return label.ident; }
 
    private:
     IdentAssembly label;
@@ -118,6 +188,13 @@ class Lw : public AssemblyNode {
     Lw(Register lhs, Register rhs) : lhs(lhs), rhs(rhs), offset(0) {}
     Lw(Register lhs, Register rhs, ImmAssembly offset) : lhs(lhs), rhs(rhs), offset(offset) {}
     void print() override;
+    std::vector<int> defs() const override { return {lhs.index}; }
+    std::vector<int> uses() const override { return {rhs.index}; }
+    std::string kind() const override { return "load"; }
+    void renameDef(int reg) override { lhs = Register(reg); }
+    int getReg() const { return lhs.index; }
+    int getBase() const { return rhs.index; }
+    int getOffset() const { return offset.value; }
 
    private:
     Register lhs, rhs;
@@ -129,6 +206,11 @@ class Sw : public AssemblyNode {
     Sw(Register lhs, Register rhs) : lhs(lhs), rhs(rhs), offset(0) {}
     Sw(Register lhs, Register rhs, ImmAssembly offset) : lhs(lhs), rhs(rhs), offset(offset) {}
     void print() override;
+    std::vector<int> uses() const override { return {lhs.index, rhs.index}; }
+    std::string kind() const override { return "store"; }
+    int getReg() const { return lhs.index; }
+    int getBase() const { return rhs.index; }
+    int getOffset() const { return offset.value; }
 
    private:
     Register lhs, rhs;
@@ -140,6 +222,8 @@ class Branch : public AssemblyNode {
     Branch(Register lhs, Register rhs, IdentAssembly label, std::string op)
         : lhs(lhs), rhs(rhs), label(label), op(op) {}
     void print() override;
+    std::vector<int> uses() const override { return {lhs.index, rhs.index}; }
+    std::string kind() const override { return "branch"; }
 
    private:
     Register lhs, rhs;
@@ -151,6 +235,9 @@ class La : public AssemblyNode {
    public:
     La(Register lhs, IdentAssembly ident) : lhs(lhs), ident(ident) {}
     void print() override;
+    std::vector<int> defs() const override { return {lhs.index}; }
+    std::string kind() const override { return "alu"; }
+    void renameDef(int reg) override { lhs = Register(reg); }
 
    private:
     Register lhs;
@@ -159,11 +246,43 @@ class La : public AssemblyNode {
 
 class WordAssembly : public AssemblyNode {
    public:
-    WordAssembly(ImmAssembly val) : val(val) {}
+    WordAssembly(std::vector<ImmAssembly> vals) : vals(vals) {}
+    void print() override;
+
+   private:
+    std::vector<ImmAssembly> vals;
+};
+
+class SpaceAssembly : public AssemblyNode {
+   public:
+    SpaceAssembly(ImmAssembly size) : size(size) {}
+    void print() override;
+
+   private:
+    ImmAssembly size;
+};
+
+// code printed by an earlier compilation, copied out as it is
+class TextAssembly : public AssemblyNode {
+   public:
+    TextAssembly(std::string text) : text(text) {}
     void print() override;
 
    private:
-    ImmAssembly val;
+    std::string text;
 };
 
+// cycles from an instruction of each kind until another may use its result, or from a store until a later access
+// to the same memory, a branch reading a result waits latencies["branch"] - 1 cycles longer
+extern std::unordered_map<std::string, int> latencies;
+// set latencies from "kind=cycles,...", false if the list is malformed
+bool setLatencies(const std::string &list);
+// reorder the instructions in each basic block after head up to tail, longest latency path first,
+// so that results are ready by the time they are used
+void scheduleBlocks(AssemblyNode *head, AssemblyNode *&tail);
+// rewrite wasteful instruction sequences after head by the rules of a table, e.g. a load of the word just stored
+void peephole(AssemblyNode *head);
+// each peephole rule and the number of rewrites it made so far
+std::vector<std::pair<std::string, int>> peepholeHits();
+
 #endif
\ No newline at end of file
@@ -666,6 +666,7 @@ class RelExp : public Exp {
     }
 
     Type typeCheck(Table *table) override;
+    void translateExp(SymbolTable *table, std::string &place, bool ignoreReturn, IRNode *&tail) override;
     void translateCond(SymbolTable *table, std::string trueLabel, std::string falseLabel, IRNode *&tail) override;
     void print(int indent = 0, bool last = false) override;
 
@@ -0,0 +1,363 @@
+#include "cache.h"
+#include <cctype>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <sstream>
+
+extern FILE *outputFile, *immediateFile;
+
+// FNV-1a, 64 bits in hex
+static std::string hashText(const std::string &text) {
+    unsigned long long hash = 14695981039346656037ull;
+    for (unsigned char c : text) {
+        hash = (hash ^ c) * 1099511628211ull;
+    }
+    char buffer[17];
+    snprintf(buffer, sizeof(buffer), "%016llx", hash);
+    return buffer;
+}
+
+// what print writes to file, with file pointed at a temporary file meanwhile
+static std::string capture(FILE *&file, const std::function<void()> &print) {
+    FILE *saved = file;
+    file = tmpfile();
+    if (!file) {
+        throw std::runtime_error("cannot create a temporary file for the cache");
+    }
+    print();
+    std::string text(ftell(file), '\0');
+    rewind(file);
+    if (fread(&text[0], 1, text.size(), file) != text.size()) {
+        throw std::runtime_error("cannot read back a temporary file for the cache");
+    }
+    fclose(file);
+    file = saved;
+    return text;
+}
+
+// text with each identifier-like token replaced by rename(token)
+static std::string renameTokens(const std::string &text, const std::function<std::string(const std::string &)> &rename) {
+    std::string result;
+    for (size_t i = 0; i < text.size();) {
+        if (!isalnum(static_cast<unsigned char>(text[i])) && text[i] != '_') {
+            result += text[i++];
+            continue;
+        }
+        size_t j = i;
+        while (j < text.size() && (isalnum(static_cast<unsigned char>(text[j])) || text[j] == '_')) {
+            ++j;
+        }
+        result += rename(text.substr(i, j - i));
+        i = j;
+    }
+    return result;
+}
+
+static bool isNumbered(const std::string &token, const std::string &prefix) {
+    return token.size() > prefix.size() && token.compare(0, prefix.size(), prefix) == 0 &&
+           std::all_of(token.begin() + prefix.size(), token.end(), [](char c) { return isdigit(c); });
+}
+
+// the nodes of the function from its FuncDefNode up to the next one
+static std::vector<IRNode *> functionNodes(FuncDefNode *func) {
+    std::vector<IRNode *> nodes = {func};
+    for (IRNode *cur = func->next; cur != nullptr && typeid(*cur) != typeid(FuncDefNode); cur = cur->next) {
+        nodes.push_back(cur);
+    }
+    return nodes;
+}
+
+// labels renamed to _L0, _L1, ... in the order they are defined
+static std::unordered_map<std::string, std::string> labelNames(const std::vector<IRNode *> &nodes) {
+    std::unordered_map<std::string, std::string> names;
+    for (auto node : nodes) {
+        if (typeid(*node) == typeid(Label)) {
+            names.emplace(static_cast<Label *>(node)->getName(), "_L" + std::to_string(names.size()));
+        }
+    }
+    return names;
+}
+
+std::string CompileCache::Entry::content() const {
+    std::vector<int> regs(clobbers.begin(), clobbers.end());
+    std::sort(regs.begin(), regs.end());
+    std::string text;
+    for (int reg : regs) {
+        text += std::to_string(reg) + " ";
+    }
+    return hashText(text + "\n" + ir + "\n" + assembly);
+}
+
+std::string CompileCache::path(const std::string &key) const {
+    return (std::filesystem::path(directory) / hashText(key)).string();
+}
+
+// an entry is a list of sections, each a name and a size followed by that many bytes
+bool CompileCache::read(const std::string &key, Entry &entry) const {
+    std::ifstream file(path(key), std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    auto section = [&](const char *name, std::string &text) {
+        std::string word;
+        size_t size;
+        if (!(file >> word >> size) || word != name || file.get() != '\n') {
+            return false;
+        }
+        text.resize(size);
+        return static_cast<bool>(file.read(&text[0], size));
+    };
+    std::string deps, clobbers;
+    if (!section("key", entry.key) || entry.key != key || !section("deps", deps) ||
+        !section("clobbers", clobbers) || !section("ir", entry.ir) || !section("asm", entry.assembly)) {
+        return false;
+    }
+    std::istringstream depStream(deps), clobberStream(clobbers);
+    for (std::string func, hash; depStream >> func >> hash;) {
+        entry.deps.emplace_back(func, hash);
+    }
+    for (int reg; clobberStream >> reg;) {
+        entry.clobbers.insert(reg);
+    }
+    return true;
+}
+
+void CompileCache::write(const Entry &entry) const {
+    std::string deps, clobbers;
+    for (auto &dep : entry.deps) {
+        deps += dep.first + " " + dep.second + "\n";
+    }
+    for (int reg : entry.clobbers) {
+        clobbers += std::to_string(reg) + " ";
+    }
+    std::string text;
+    auto section = [&](const char *name, const std::string &body) {
+        text += std::string(name) + " " + std::to_string(body.size()) + "\n" + body;
+    };
+    section("key", entry.key);
+    section("deps", deps);
+    section("clobbers", clobbers);
+    section("ir", entry.ir);
+    section("asm", entry.assembly);
+
+    // written aside and renamed, so a compilation reading the cache never sees half an entry
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    std::string target = path(entry.key), temporary = target + ".tmp";
+    std::ofstream file(temporary, std::ios::binary);
+    if (!file.write(text.data(), text.size()) || (file.close(), !file)) {
+        throw std::runtime_error("cannot write the cache entry " + temporary);
+    }
+    std::filesystem::rename(temporary, target, error);
+    if (error) {
+        throw std::runtime_error("cannot write the cache entry " + target);
+    }
+}
+
+void CompileCache::load(IRNode *root) {
+    // declarations of the globals, which all come before the functions
+    std::unordered_map<std::string, std::string> globals;
+    std::vector<std::string> globalOrder;
+    std::vector<FuncDefNode *> funcs;
+    for (IRNode *cur = root->next; cur != nullptr; cur = cur->next) {
+        if (typeid(*cur) == typeid(FuncDefNode)) {
+            funcs.push_back(static_cast<FuncDefNode *>(cur));
+        } else if (funcs.empty()) {
+            if (typeid(*cur) == typeid(GlobalVar)) {
+                globalOrder.push_back(static_cast<GlobalVar *>(cur)->getIdent().ident);
+            }
+            if (!globalOrder.empty()) {
+                globals[globalOrder.back()] += capture(immediateFile, [cur]() { cur->print(); });
+            }
+        }
+    }
+
+    // keys: the function with its labels and temps numbered from 0, its profile counts,
+    // the globals it names and the options
+    std::unordered_map<std::string, std::unordered_set<std::string>> callees, used;
+    for (auto func : funcs) {
+        std::string name = func->getName();
+        std::vector<IRNode *> nodes = functionNodes(func);
+        std::unordered_map<std::string, std::string> labels = labelNames(nodes), temps;
+        std::string text = capture(immediateFile, [&nodes]() {
+            for (auto node : nodes) {
+                node->print();
+                if (node->count >= 0) {
+                    fprintf(immediateFile, "@%lld\n", node->count);
+                }
+            }
+        });
+        text = renameTokens(text, [&](const std::string &token) {
+            if (labels.count(token)) {
+                return labels[token];
+            }
+            if (isNumbered(token, "_t")) {
+                return temps.emplace(token, "_T" + std::to_string(temps.size())).first->second;
+            }
+            if (globals.count(token)) {
+                used[name].insert(token);
+            }
+            return token;
+        });
+        for (auto node : nodes) {
+            if (typeid(*node) == typeid(Call) || typeid(*node) == typeid(CallWithRet)) {
+                callees[name].insert(static_cast<CallNode *>(node)->getName());
+            }
+        }
+        std::string key = "options " + options + "\n";
+        for (auto &global : globalOrder) {
+            if (used[name].count(global)) {
+                key += globals[global];
+            }
+        }
+        keys[name] = key + text;
+    }
+
+    // a function relies on what its callees do, directly or not, and on how the others use its globals
+    for (auto func : funcs) {
+        std::string name = func->getName();
+        std::unordered_set<std::string> reached;
+        std::vector<std::string> stack = {name};
+        while (!stack.empty()) {
+            std::string cur = stack.back();
+            stack.pop_back();
+            for (auto &callee : callees[cur]) {
+                if (keys.count(callee) && reached.insert(callee).second) {
+                    stack.push_back(callee);
+                }
+            }
+        }
+        for (auto other : funcs) {
+            for (auto &global : used[other->getName()]) {
+                if (used[name].count(global)) {
+                    reached.insert(other->getName());
+                    break;
+                }
+            }
+        }
+        reached.erase(name);
+        deps[name] = std::vector<std::string>(reached.begin(), reached.end());
+        std::sort(deps[name].begin(), deps[name].end());
+    }
+
+    // an entry is reused when the functions it relied on are reused too, with the same code as back then
+    for (auto func : funcs) {
+        Entry entry;
+        if (read(keys[func->getName()], entry)) {
+            entries[func->getName()] = entry;
+            hits.insert(func->getName());
+        }
+    }
+    std::unordered_map<std::string, std::string> contents;
+    for (auto &entry : entries) {
+        contents[entry.first] = entry.second.content();
+    }
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (auto it = hits.begin(); it != hits.end();) {
+            const Entry &entry = entries[*it];
+            bool valid = entry.deps.size() == deps[*it].size();
+            for (auto i = 0ull; valid && i < entry.deps.size(); ++i) {
+                valid = entry.deps[i].first == deps[*it][i] && hits.count(entry.deps[i].first) &&
+                        contents[entry.deps[i].first] == entry.deps[i].second;
+            }
+            if (valid) {
+                ++it;
+            } else {
+                it = hits.erase(it);
+                changed = true;
+            }
+        }
+    }
+
+    // the hits take their optimized IR, labels prefixed with the function name to stay unique
+    IRNode *prev = root;
+    while (!funcs.empty() && prev->next != funcs[0]) {
+        prev = prev->next;
+    }
+    for (auto func : funcs) {
+        std::vector<IRNode *> nodes = functionNodes(func);
+        std::string name = func->getName();
+        if (!hits.count(name)) {
+            prev = nodes.back();
+            continue;
+        }
+        auto rename = [&name](const std::string &token) { return isNumbered(token, "_L") ? name + token : token; };
+        const Entry &entry = entries[name];
+        cached[name] = {renameTokens(entry.assembly, rename), entry.clobbers};
+        IRNode *head = readIR(renameTokens(entry.ir, rename)), *tail = head;
+        while (tail->next != nullptr) {
+            tail = tail->next;
+        }
+        tail->next = nodes.back()->next;
+        nodes.back()->next = nullptr;
+        delete prev->next;
+        prev->next = head->next;
+        head->next = nullptr;
+        delete head;
+        prev = tail;
+    }
+}
+
+void CompileCache::store(IRNode *root, AssemblyNode *asmRoot, GenerateTable *table) {
+    // the code of each function runs from its label to the next function, cached ones printed as one node
+    std::unordered_map<std::string, AssemblyNode *> code;
+    std::vector<AssemblyNode *> starts;
+    for (AssemblyNode *cur = asmRoot->next; cur != nullptr; cur = cur->next) {
+        if (typeid(*cur) == typeid(TextAssembly)) {
+            starts.push_back(cur);
+        } else if (typeid(*cur) == typeid(LabelAssembly) &&
+                   keys.count(static_cast<LabelAssembly *>(cur)->getLabel())) {
+            code[static_cast<LabelAssembly *>(cur)->getLabel()] = cur;
+            starts.push_back(cur);
+        }
+    }
+    std::unordered_set<AssemblyNode *> boundaries(starts.begin(), starts.end());
+
+    std::unordered_map<std::string, Entry> compiled;
+    std::unordered_map<std::string, std::string> contents;
+    for (auto &entry : entries) {
+        contents[entry.first] = entry.second.content();
+    }
+    for (IRNode *cur = root->next; cur != nullptr; cur = cur->next) {
+        if (typeid(*cur) != typeid(FuncDefNode) || hits.count(static_cast<FuncDefNode *>(cur)->getName())) {
+            continue;
+        }
+        std::string name = static_cast<FuncDefNode *>(cur)->getName();
+        std::vector<IRNode *> nodes = functionNodes(static_cast<FuncDefNode *>(cur));
+        std::unordered_map<std::string, std::string> labels = labelNames(nodes);
+        auto rename = [&labels](const std::string &token) {
+            auto it = labels.find(token);
+            return it == labels.end() ? token : it->second;
+        };
+        Entry &entry = compiled[name];
+        entry.key = keys[name];
+        entry.clobbers = table->getClobbers(name);
+        entry.ir = renameTokens(capture(immediateFile,
+                                        [&nodes]() {
+                                            for (auto node : nodes) {
+                                                node->print();
+                                            }
+                                        }),
+                                rename);
+        AssemblyNode *start = code.at(name);
+        entry.assembly = renameTokens(capture(outputFile,
+                                              [start, &boundaries]() {
+                                                  AssemblyNode *cur = start;
+                                                  do {
+                                                      cur->print();
+                                                      cur = cur->next;
+                                                  } while (cur != nullptr && !boundaries.count(cur));
+                                              }),
+                                      rename);
+        contents[name] = entry.content();
+    }
+    for (auto &item : compiled) {
+        for (auto &dep : deps[item.first]) {
+            item.second.deps.emplace_back(dep, contents[dep]);
+        }
+        write(item.second);
+    }
+}
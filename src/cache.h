@@ -0,0 +1,48 @@
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#include "assembly.h"
+#include "ir.h"
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// the optimized IR and assembly of each function kept in a directory from one compilation to the next,
+// under a hash of its translated IR, the globals it uses and the options
+class CompileCache {
+   public:
+    CompileCache(std::string directory, std::string options) : directory(directory), options(options) {}
+
+    // look up the functions of the translated program and put the optimized IR of the hits in place of theirs
+    void load(IRNode *root);
+    // write the functions compiled this time, from the optimized program and its assembly
+    void store(IRNode *root, AssemblyNode *asmRoot, GenerateTable *table);
+
+    const std::unordered_set<std::string> &getHits() const { return hits; }
+    const std::unordered_map<std::string, CachedFunction> &getCached() const { return cached; }
+    int getMisses() const { return keys.size() - hits.size(); }
+
+   private:
+    struct Entry {
+        std::string key;
+        std::vector<std::pair<std::string, std::string>> deps;  // function, hash of its content
+        std::unordered_set<int> clobbers;
+        std::string ir, assembly;
+        std::string content() const;
+    };
+
+    std::string path(const std::string &key) const;
+    bool read(const std::string &key, Entry &entry) const;
+    void write(const Entry &entry) const;
+
+    std::string directory, options;
+    std::unordered_map<std::string, std::string> keys;
+    // the functions whose code a function's code relies on: callees, and those sharing a global with it
+    std::unordered_map<std::string, std::vector<std::string>> deps;
+    std::unordered_map<std::string, Entry> entries;
+    std::unordered_set<std::string> hits;
+    std::unordered_map<std::string, CachedFunction> cached;
+};
+
+#endif
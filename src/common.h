@@ -12,7 +12,18 @@ const std::vector<std::string> REGISTER_NAMES = {"zero", "ra", "sp", "gp", "tp",
 const std::vector<int> TEMP_REGISTERS = {5, 6, 7, 28, 29, 30, 31};
 const std::vector<int> SAVED_REGISTERS = {8, 9, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27};
 const std::vector<int> ARG_REGISTERS = {10, 11, 12, 13, 14, 15, 16, 17};
+const int FRAME_SCRATCH = 4;  // tp, never allocated, reaches stack slots beyond a 12-bit offset
 
+const std::string MINILIB =
+    "read:\n\
+    li a0,6\n\
+    ecall\n\
+    ret\n\
+write:\n\
+    mv a1,a0\n\
+    li a0,1\n\
+    ecall\n\
+    ret\n";
 const std::string TEXT =
     ".text\n\
 _minilib_start:\n\
@@ -20,16 +31,32 @@ _minilib_start:\n\
     call main\n\
     mv a1,a0\n\
     li a0,17\n\
-    ecall\n\
-read:\n\
-    li a0,6\n\
-    ecall\n\
-    ret\n\
-write:\n\
-    mv a1,a0\n\
+    ecall\n" +
+    MINILIB;
+// the global of a --profile-generate build holding the number of counters, then the counters
+const std::string PROFILE_COUNTERS = "_profile0";
+// on exit each word of PROFILE_COUNTERS is written as -(word + 1), to tell it apart from the output of the program
+const std::string PROFILE_TEXT =
+    ".text\n\
+_minilib_start:\n\
+    la sp,_stack_top\n\
+    call main\n\
+    mv s0,a0\n\
+    la s1," + PROFILE_COUNTERS + "\n\
+    lw s2,0(s1)\n\
+    slli s2,s2,2\n\
+    add s2,s2,s1\n\
+_profile_dump:\n\
+    lw a1,0(s1)\n\
+    xori a1,a1,-1\n\
     li a0,1\n\
     ecall\n\
-    ret\n";
+    addi s1,s1,4\n\
+    bge s2,s1,_profile_dump\n\
+    mv a1,s0\n\
+    li a0,17\n\
+    ecall\n" +
+    MINILIB;
 const std::string DATA =
     ".data\n\
     .align 4\n\
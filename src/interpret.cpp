@@ -0,0 +1,593 @@
+#include "ir.h"
+#include <climits>
+
+/*
+IR 解释器: 与 ir.py 的语义一致, 但先把 IR 翻译为线性的指令数组再执行.
+变量在加载时解析为栈帧中的槽位, 标签解析为指令下标, 函数解析为函数下标;
+每条指令记录其处理代码的地址, 执行完直接跳到下一条指令的处理代码 (direct threading).
+运算按目标机器的 32 位语义进行, 与 optimize.cpp 中常量折叠的结果一致.
+*/
+
+namespace {
+
+enum Op {
+    LI,
+    MOV,
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    MOD,
+    LT,
+    GT,
+    LE,
+    GE,
+    EQ,
+    NE,
+    ADDI,
+    SUBI,
+    MULI,
+    DIVI,
+    MODI,
+    LTI,
+    GTI,
+    LEI,
+    GEI,
+    EQI,
+    NEI,
+    NEG,
+    NOT,
+    LOAD,
+    STORE,
+    GOTO,
+    IF_LT,
+    IF_GT,
+    IF_LE,
+    IF_GE,
+    IF_EQ,
+    IF_NE,
+    ARG,
+    PARAM,
+    CALL,
+    READ,
+    WRITE,
+    RET,
+    RET_VOID,
+    DEC,
+    LA,
+    // errors found when loading, raised only if the program gets there as ir.py does
+    NO_LABEL,
+    NO_FUNCTION,
+    NO_GLOBAL,
+    NO_RETURN,
+    NUM_OPS,
+};
+
+// operands are frame slots, immediates, or indices of instructions, functions and names
+struct Insn {
+    Op op;
+    int dst = -1, a = 0, b = 0;
+    IRNode *node = nullptr;
+    const void *handler = nullptr;
+    long long count = 0;
+};
+
+struct Function {
+    std::string name;
+    FuncDefNode *node;
+    int entry = 0, slots = 0;
+    std::vector<std::string> names;  // of the slots
+    long long calls = 0;
+};
+
+struct Frame {
+    int function;
+    Insn *ret;
+    size_t base;
+    int dst;
+    std::vector<long long> params;
+    size_t nextParam = 0;
+};
+
+const long long UNDEFINED = LLONG_MIN;  // slot never assigned
+const int HEAP_BASE = 0x1000;           // address of the first array, as in ir.py
+
+[[noreturn]] void fail(const std::string &message) { throw std::runtime_error(message); }
+
+const std::unordered_map<std::string, Op> BINARY_OPS = {
+    {"+", ADD}, {"-", SUB}, {"*", MUL}, {"/", DIV}, {"%", MOD}, {"<", LT}, {">", GT},
+    {"<=", LE}, {">=", GE}, {"==", EQ}, {"!=", NE}};
+const std::unordered_map<std::string, Op> BRANCH_OPS = {{"<", IF_LT}, {">", IF_GT},  {"<=", IF_LE},
+                                                        {">=", IF_GE}, {"==", IF_EQ}, {"!=", IF_NE}};
+
+class Program {
+   public:
+    Program(IRNode *root);
+    int run(FILE *input, FILE *output);
+    void saveCounts();
+
+   private:
+    int slot(Function &func, std::unordered_map<std::string, int> &slots, const std::string &ident);
+    int name(const std::string &text);
+    int allocate(int size);
+
+    std::vector<Insn> code;
+    std::vector<Function> funcs;
+    std::vector<std::string> names;
+    std::vector<std::pair<IRNode *, int>> labels;  // label nodes and the instruction they stand before
+    std::vector<int> memory;                       // words from HEAP_BASE on
+    unsigned int seed = 1;
+    int mainIndex = -1;
+};
+
+int Program::slot(Function &func, std::unordered_map<std::string, int> &slots, const std::string &ident) {
+    auto it = slots.find(ident);
+    if (it != slots.end()) {
+        return it->second;
+    }
+    func.names.push_back(ident);
+    return slots[ident] = func.slots++;
+}
+
+int Program::name(const std::string &text) {
+    names.push_back(text);
+    return names.size() - 1;
+}
+
+// new words filled with garbage as ir.py does, so reading them before writing shows
+int Program::allocate(int size) {
+    int address = HEAP_BASE + memory.size() * SIZE_OF_INT;
+    for (int i = 0; i < size / SIZE_OF_INT; ++i) {
+        seed = seed * 1103515245 + 12345;
+        memory.push_back((seed >> 16) % 0xffff + 1);
+    }
+    return address;
+}
+
+Program::Program(IRNode *root) {
+    // globals come first, each a GLOBAL followed by its words and zeros
+    std::unordered_map<std::string, int> globals;
+    IRNode *cur = root->next;
+    std::vector<std::pair<std::string, std::vector<int>>> data;
+    for (; cur != nullptr && typeid(*cur) != typeid(FuncDefNode); cur = cur->next) {
+        if (typeid(*cur) == typeid(GlobalVar)) {
+            data.emplace_back(static_cast<GlobalVar *>(cur)->getIdent().ident, std::vector<int>());
+        } else if (data.empty()) {
+            throw std::runtime_error("IR should start with a FUNCTION or GLOBAL");
+        } else if (typeid(*cur) == typeid(Word)) {
+            auto values = static_cast<Word *>(cur)->getValues();
+            data.back().second.insert(data.back().second.end(), values.begin(), values.end());
+        } else if (typeid(*cur) == typeid(Zero)) {
+            data.back().second.resize(data.back().second.size() + static_cast<Zero *>(cur)->getSize().value / 4);
+        } else {
+            throw std::runtime_error("IR should start with a FUNCTION or GLOBAL");
+        }
+    }
+    for (auto &item : data) {
+        globals[item.first] = allocate(item.second.size() * SIZE_OF_INT);
+        std::copy(item.second.begin(), item.second.end(), memory.end() - item.second.size());
+    }
+
+    // functions, with the jumps and calls resolved once all are known
+    std::unordered_map<std::string, int> funcIndex;
+    std::vector<std::pair<int, std::string>> calls;
+    for (; cur != nullptr;) {
+        if (typeid(*cur) != typeid(FuncDefNode)) {
+            throw std::runtime_error("Global variable should be defined before function");
+        }
+        funcIndex[static_cast<FuncDefNode *>(cur)->getName()] = funcs.size();
+        funcs.push_back(Function());
+        Function &func = funcs.back();
+        func.name = static_cast<FuncDefNode *>(cur)->getName();
+        func.node = static_cast<FuncDefNode *>(cur);
+        func.entry = code.size();
+        std::unordered_map<std::string, int> slots, labelIndex;
+        std::vector<std::pair<int, std::string>> jumps;
+        auto var = [&](const Identifier &ident) { return slot(func, slots, ident.ident); };
+        for (cur = cur->next; cur != nullptr && typeid(*cur) != typeid(FuncDefNode); cur = cur->next) {
+            Insn insn;
+            insn.node = cur;
+            if (typeid(*cur) == typeid(Label)) {
+                labelIndex[static_cast<Label *>(cur)->getName()] = code.size();
+                labels.emplace_back(cur, code.size());
+                continue;
+            } else if (typeid(*cur) == typeid(LoadImm)) {
+                auto node = static_cast<LoadImm *>(cur);
+                insn.op = LI, insn.dst = var(node->getIdent()), insn.a = node->getValue().value;
+            } else if (typeid(*cur) == typeid(Assign)) {
+                auto node = static_cast<Assign *>(cur);
+                insn.op = MOV, insn.dst = var(node->getLhs()), insn.a = var(node->getRhs());
+            } else if (typeid(*cur) == typeid(Binop)) {
+                auto node = static_cast<Binop *>(cur);
+                insn.op = BINARY_OPS.at(node->getOp());
+                insn.dst = var(node->getLhs()), insn.a = var(node->getRhs1()), insn.b = var(node->getRhs2());
+            } else if (typeid(*cur) == typeid(BinopImm)) {
+                auto node = static_cast<BinopImm *>(cur);
+                insn.op = static_cast<Op>(BINARY_OPS.at(node->getOp()) - ADD + ADDI);
+                insn.dst = var(node->getLhs()), insn.a = var(node->getRhs()), insn.b = node->getImm().value;
+            } else if (typeid(*cur) == typeid(Unop)) {
+                auto node = static_cast<Unop *>(cur);
+                insn.op = node->getOp() == "-" ? NEG : node->getOp() == "!" ? NOT : MOV;
+                insn.dst = var(node->getLhs()), insn.a = var(node->getRhs());
+            } else if (typeid(*cur) == typeid(Load)) {
+                auto node = static_cast<Load *>(cur);
+                insn.op = LOAD, insn.dst = var(node->getLhs()), insn.a = var(node->getRhs());
+            } else if (typeid(*cur) == typeid(Store)) {
+                auto node = static_cast<Store *>(cur);
+                insn.op = STORE, insn.a = var(node->getLhs()), insn.b = var(node->getRhs());
+            } else if (typeid(*cur) == typeid(Goto)) {
+                insn.op = GOTO;
+                jumps.emplace_back(code.size(), static_cast<Goto *>(cur)->getLabel());
+            } else if (typeid(*cur) == typeid(CondGoto)) {
+                auto node = static_cast<CondGoto *>(cur);
+                insn.op = BRANCH_OPS.at(node->getOp());
+                insn.a = var(node->getLhs()), insn.b = var(node->getRhs());
+                jumps.emplace_back(code.size(), node->getLabel());
+            } else if (typeid(*cur) == typeid(Call) || typeid(*cur) == typeid(CallWithRet)) {
+                auto node = static_cast<CallNode *>(cur);
+                insn.op = node->getName() == "read" ? READ : node->getName() == "write" ? WRITE : CALL;
+                insn.dst = typeid(*cur) == typeid(CallWithRet) ? var(node->getLhs()) : -1;
+                if (insn.op == CALL) {
+                    calls.emplace_back(code.size(), node->getName());
+                }
+            } else if (typeid(*cur) == typeid(Param)) {
+                insn.op = PARAM, insn.dst = var(static_cast<Param *>(cur)->getIdent());
+            } else if (typeid(*cur) == typeid(Arg)) {
+                insn.op = ARG, insn.a = var(static_cast<Arg *>(cur)->getIdent());
+            } else if (typeid(*cur) == typeid(ReturnWithVal)) {
+                insn.op = RET, insn.a = var(static_cast<ReturnWithVal *>(cur)->getIdent());
+            } else if (typeid(*cur) == typeid(Return)) {
+                insn.op = RET_VOID;
+            } else if (typeid(*cur) == typeid(VarDec)) {
+                auto node = static_cast<VarDec *>(cur);
+                insn.op = DEC, insn.dst = var(node->getIdent()), insn.a = node->getSize().value;
+            } else if (typeid(*cur) == typeid(LoadGlobal)) {
+                auto node = static_cast<LoadGlobal *>(cur);
+                insn.dst = var(node->getLhs());
+                auto it = globals.find(node->getRhs().ident);
+                if (it != globals.end()) {
+                    insn.op = LA, insn.a = it->second;
+                } else {
+                    insn.op = NO_GLOBAL, insn.a = name(node->getRhs().ident);
+                }
+            } else {
+                throw std::runtime_error("the interpreter cannot run this IR node");
+            }
+            code.push_back(insn);
+        }
+        Insn end;
+        end.op = NO_RETURN, end.a = funcs.size() - 1;
+        code.push_back(end);
+        for (auto &jump : jumps) {
+            auto it = labelIndex.find(jump.second);
+            if (it != labelIndex.end()) {
+                code[jump.first].dst = it->second;
+            } else {
+                Insn missing;
+                missing.op = NO_LABEL, missing.a = name(jump.second), missing.b = funcs.size() - 1;
+                code[jump.first].dst = code.size();
+                code.push_back(missing);
+            }
+        }
+    }
+    for (auto &call : calls) {
+        auto it = funcIndex.find(call.second);
+        if (it != funcIndex.end()) {
+            code[call.first].a = it->second;
+        } else {
+            code[call.first].op = NO_FUNCTION, code[call.first].a = name(call.second);
+        }
+    }
+    if (!funcIndex.count("main")) {
+        throw std::runtime_error("No main function");
+    }
+    mainIndex = funcIndex["main"];
+}
+
+
+#define VALUE(slot)                                                                                             \
+    (fp[slot] != UNDEFINED ? static_cast<int>(fp[slot])                                                         \
+                           : (fail("Variable " + funcs[frames.back().function].names[slot] + " is not defined"), \
+                              0))
+#define ADDRESS(slot)                                                                                 \
+    ([&]() {                                                                                          \
+        long long address = VALUE(slot);                                                              \
+        if (address < HEAP_BASE || address >= HEAP_BASE + static_cast<long long>(memory.size()) * 4) { \
+            fail("address " + std::to_string(address) + " not found");                            \
+        }                                                                                             \
+        return (address - HEAP_BASE) / 4;                                                             \
+    }())
+
+#ifdef __GNUC__
+#define DISPATCH()         \
+    do {                   \
+        ++pc->count;       \
+        goto *pc->handler; \
+    } while (0)
+#define HANDLER(op) op##_HANDLER:
+#else
+#define DISPATCH()        \
+    do {                  \
+        ++pc->count;      \
+        goto dispatch;    \
+    } while (0)
+#define HANDLER(op) case op:
+#endif
+
+int Program::run(FILE *input, FILE *output) {
+#ifdef __GNUC__
+    static const void *const handlers[NUM_OPS] = {
+        &&LI_HANDLER,      &&MOV_HANDLER,     &&ADD_HANDLER,      &&SUB_HANDLER,         &&MUL_HANDLER,
+        &&DIV_HANDLER,     &&MOD_HANDLER,     &&LT_HANDLER,       &&GT_HANDLER,          &&LE_HANDLER,
+        &&GE_HANDLER,      &&EQ_HANDLER,      &&NE_HANDLER,       &&ADDI_HANDLER,        &&SUBI_HANDLER,
+        &&MULI_HANDLER,    &&DIVI_HANDLER,    &&MODI_HANDLER,     &&LTI_HANDLER,         &&GTI_HANDLER,
+        &&LEI_HANDLER,     &&GEI_HANDLER,     &&EQI_HANDLER,      &&NEI_HANDLER,         &&NEG_HANDLER,
+        &&NOT_HANDLER,     &&LOAD_HANDLER,    &&STORE_HANDLER,    &&GOTO_HANDLER,        &&IF_LT_HANDLER,
+        &&IF_GT_HANDLER,   &&IF_LE_HANDLER,   &&IF_GE_HANDLER,    &&IF_EQ_HANDLER,       &&IF_NE_HANDLER,
+        &&ARG_HANDLER,     &&PARAM_HANDLER,   &&CALL_HANDLER,     &&READ_HANDLER,        &&WRITE_HANDLER,
+        &&RET_HANDLER,     &&RET_VOID_HANDLER, &&DEC_HANDLER,     &&LA_HANDLER,          &&NO_LABEL_HANDLER,
+        &&NO_FUNCTION_HANDLER, &&NO_GLOBAL_HANDLER, &&NO_RETURN_HANDLER};
+    for (auto &insn : code) {
+        insn.handler = handlers[insn.op];
+    }
+#endif
+    std::vector<long long> stack(funcs[mainIndex].slots, UNDEFINED);
+    std::vector<Frame> frames = {{mainIndex, nullptr, 0, -1, {}}};
+    std::vector<long long> args;
+    long long *fp = stack.data();
+    long long result = 0;
+    Insn *pc = &code[funcs[mainIndex].entry];
+    ++funcs[mainIndex].calls;
+
+    // wrapping 32-bit arithmetic, division as the target does it
+    auto arith = [&](Op op, int lhs, int rhs) -> int {
+        unsigned int a = lhs, b = rhs;
+        switch (op) {
+            case ADD: return a + b;
+            case SUB: return a - b;
+            case MUL: return a * b;
+            case DIV:
+            case MOD:
+                if (rhs == 0) {
+                    fail("division by zero");
+                }
+                if (lhs == INT_MIN && rhs == -1) {
+                    return op == DIV ? INT_MIN : 0;
+                }
+                return op == DIV ? lhs / rhs : lhs % rhs;
+            case LT: return lhs < rhs;
+            case GT: return lhs > rhs;
+            case LE: return lhs <= rhs;
+            case GE: return lhs >= rhs;
+            case EQ: return lhs == rhs;
+            default: return lhs != rhs;
+        }
+    };
+
+    DISPATCH();
+#ifndef __GNUC__
+dispatch:
+    switch (pc->op) {
+#endif
+    HANDLER(LI) {
+        fp[pc->dst] = pc->a;
+        ++pc;
+        DISPATCH();
+    }
+    HANDLER(MOV) {
+        fp[pc->dst] = VALUE(pc->a);
+        ++pc;
+        DISPATCH();
+    }
+    HANDLER(ADD) {
+        fp[pc->dst] = static_cast<int>(static_cast<unsigned int>(VALUE(pc->a)) + VALUE(pc->b));
+        ++pc;
+        DISPATCH();
+    }
+    HANDLER(SUB) {
+        fp[pc->dst] = static_cast<int>(static_cast<unsigned int>(VALUE(pc->a)) - VALUE(pc->b));
+        ++pc;
+        DISPATCH();
+    }
+    HANDLER(MUL)
+    HANDLER(DIV)
+    HANDLER(MOD)
+    HANDLER(LT)
+    HANDLER(GT)
+    HANDLER(LE)
+    HANDLER(GE)
+    HANDLER(EQ)
+    HANDLER(NE) {
+        fp[pc->dst] = arith(pc->op, VALUE(pc->a), VALUE(pc->b));
+        ++pc;
+        DISPATCH();
+    }
+    HANDLER(ADDI) {
+        fp[pc->dst] = static_cast<int>(static_cast<unsigned int>(VALUE(pc->a)) + pc->b);
+        ++pc;
+        DISPATCH();
+    }
+    HANDLER(SUBI)
+    HANDLER(MULI)
+    HANDLER(DIVI)
+    HANDLER(MODI)
+    HANDLER(LTI)
+    HANDLER(GTI)
+    HANDLER(LEI)
+    HANDLER(GEI)
+    HANDLER(EQI)
+    HANDLER(NEI) {
+        fp[pc->dst] = arith(static_cast<Op>(pc->op - ADDI + ADD), VALUE(pc->a), pc->b);
+        ++pc;
+        DISPATCH();
+    }
+    HANDLER(NEG) {
+        fp[pc->dst] = static_cast<int>(0u - VALUE(pc->a));
+        ++pc;
+        DISPATCH();
+    }
+    HANDLER(NOT) {
+        fp[pc->dst] = VALUE(pc->a) == 0;
+        ++pc;
+        DISPATCH();
+    }
+    HANDLER(LOAD) {
+        fp[pc->dst] = memory[ADDRESS(pc->a)];
+        ++pc;
+        DISPATCH();
+    }
+    HANDLER(STORE) {
+        memory[ADDRESS(pc->a)] = VALUE(pc->b);
+        ++pc;
+        DISPATCH();
+    }
+    HANDLER(GOTO) {
+        pc = &code[pc->dst];
+        DISPATCH();
+    }
+    HANDLER(IF_LT) {
+        pc = VALUE(pc->a) < VALUE(pc->b) ? &code[pc->dst] : pc + 1;
+        DISPATCH();
+    }
+    HANDLER(IF_GT) {
+        pc = VALUE(pc->a) > VALUE(pc->b) ? &code[pc->dst] : pc + 1;
+        DISPATCH();
+    }
+    HANDLER(IF_LE) {
+        pc = VALUE(pc->a) <= VALUE(pc->b) ? &code[pc->dst] : pc + 1;
+        DISPATCH();
+    }
+    HANDLER(IF_GE) {
+        pc = VALUE(pc->a) >= VALUE(pc->b) ? &code[pc->dst] : pc + 1;
+        DISPATCH();
+    }
+    HANDLER(IF_EQ) {
+        pc = VALUE(pc->a) == VALUE(pc->b) ? &code[pc->dst] : pc + 1;
+        DISPATCH();
+    }
+    HANDLER(IF_NE) {
+        pc = VALUE(pc->a) != VALUE(pc->b) ? &code[pc->dst] : pc + 1;
+        DISPATCH();
+    }
+    HANDLER(ARG) {
+        args.push_back(VALUE(pc->a));
+        ++pc;
+        DISPATCH();
+    }
+    HANDLER(PARAM) {
+        Frame &frame = frames.back();
+        if (frame.nextParam == frame.params.size()) {
+            fail("Function " + funcs[frame.function].name + " needs more parameters");
+        }
+        fp[pc->dst] = frame.params[frame.nextParam++];
+        ++pc;
+        DISPATCH();
+    }
+    HANDLER(CALL) {
+        Function &callee = funcs[pc->a];
+        ++callee.calls;
+        frames.push_back({pc->a, pc + 1, stack.size(), pc->dst, std::move(args)});
+        args.clear();
+        stack.resize(stack.size() + callee.slots, UNDEFINED);
+        fp = &stack[frames.back().base];
+        pc = &code[callee.entry];
+        DISPATCH();
+    }
+    HANDLER(READ) {
+        int value;
+        if (fscanf(input, "%d", &value) != 1) {
+            fail("no input left for read");
+        }
+        if (pc->dst >= 0) {
+            fp[pc->dst] = value;
+        }
+        ++pc;
+        DISPATCH();
+    }
+    HANDLER(WRITE) {
+        if (args.empty()) {
+            fail("write needs an argument");
+        }
+        fprintf(output, "%d\n", static_cast<int>(args[0]));
+        args.clear();
+        ++pc;
+        DISPATCH();
+    }
+    HANDLER(RET) {
+        result = VALUE(pc->a);
+        goto leave;
+    }
+    HANDLER(RET_VOID) {
+        result = UNDEFINED;
+        goto leave;
+    }
+    HANDLER(DEC) {
+        fp[pc->dst] = allocate(pc->a);
+        ++pc;
+        DISPATCH();
+    }
+    HANDLER(LA) {
+        fp[pc->dst] = pc->a;
+        ++pc;
+        DISPATCH();
+    }
+    HANDLER(NO_LABEL) {
+        fail("Label " + names[pc->a] + " in function " + funcs[pc->b].name + " is not defined");
+    }
+    HANDLER(NO_FUNCTION) {
+        fail("Variable " + names[pc->a] + " is not defined");
+    }
+    HANDLER(NO_GLOBAL) {
+        fail("Label " + names[pc->a] + " in function " + funcs[frames.back().function].name + " is not defined");
+    }
+    HANDLER(NO_RETURN) {
+        fail("No return statement in function " + funcs[pc->a].name);
+    }
+#ifndef __GNUC__
+        default:
+            break;
+    }
+#endif
+
+leave : {
+    Frame frame = std::move(frames.back());
+    frames.pop_back();
+    args.clear();
+    if (frames.empty()) {
+        return result == UNDEFINED ? 0 : result;
+    }
+    stack.resize(frame.base);
+    fp = &stack[frames.back().base];
+    if (frame.dst >= 0) {
+        fp[frame.dst] = result;
+    }
+    pc = frame.ret;
+    DISPATCH();
+}
+}
+
+void Program::saveCounts() {
+    for (auto &insn : code) {
+        if (insn.node != nullptr) {
+            insn.node->count = insn.count;
+        }
+    }
+    // a label runs as often as the instruction after it
+    for (auto &label : labels) {
+        label.first->count = code[label.second].count;
+    }
+    for (auto &func : funcs) {
+        func.node->count = func.calls;
+    }
+}
+
+}  // namespace
+
+int interpretIR(IRNode *root, FILE *input, FILE *output, bool profile) {
+    Program program(root);
+    int result = program.run(input, output);
+    if (profile) {
+        program.saveCounts();
+    }
+    return result;
+}
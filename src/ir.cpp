@@ -2,9 +2,14 @@
 #include <string.h>
 #include <cstdarg>
 #include <cassert>
+#include <climits>
+#include <cstdlib>
 
 extern FILE *immediateFile;
 
+bool graphColoring = false;
+bool postSchedule = true;
+
 static void printToFile(FILE *file, const char *format, ...) {
     if (strncmp(format, "LABEL", 5) == 0) {
         fprintf(file, "  ");
@@ -27,6 +32,59 @@ static void linkToTail(AssemblyNode *&tail, AssemblyNode *target) {
     tail = target;
 }
 
+// the low 12 bits of offset, sign extended as an access does, offset minus them is a multiple of 4096 for lui
+static int lowOffset(int offset) { return ((offset & 0xfff) ^ 0x800) - 0x800; }
+
+// reg = sp + offset
+static void addressStack(AssemblyNode *&tail, Register reg, int offset) {
+    if (isImm12(offset)) {
+        linkToTail(tail, new BinaryImmAssembly(reg, Register(2), ImmAssembly(offset), "+"));
+    } else {
+        linkToTail(tail, new Li(reg, ImmAssembly(offset)));
+        linkToTail(tail, new BinaryAssembly(reg, Register(2), reg, "+"));
+    }
+}
+
+// lw and sw of the stack slot at sp + offset, a far slot through the frame scratch register
+static void loadStack(AssemblyNode *&tail, Register reg, int offset) {
+    if (isImm12(offset)) {
+        linkToTail(tail, new Lw(reg, Register(2), offset));
+    } else {
+        linkToTail(tail, new Li(Register(FRAME_SCRATCH), ImmAssembly(offset - lowOffset(offset))));
+        linkToTail(tail, new BinaryAssembly(Register(FRAME_SCRATCH), Register(2), Register(FRAME_SCRATCH), "+"));
+        linkToTail(tail, new Lw(reg, Register(FRAME_SCRATCH), lowOffset(offset)));
+    }
+}
+
+static void storeStack(AssemblyNode *&tail, Register reg, int offset) {
+    if (isImm12(offset)) {
+        linkToTail(tail, new Sw(reg, Register(2), offset));
+    } else {
+        linkToTail(tail, new Li(Register(FRAME_SCRATCH), ImmAssembly(offset - lowOffset(offset))));
+        linkToTail(tail, new BinaryAssembly(Register(FRAME_SCRATCH), Register(2), Register(FRAME_SCRATCH), "+"));
+        linkToTail(tail, new Sw(reg, Register(FRAME_SCRATCH), lowOffset(offset)));
+    }
+}
+
+// sp += size, by li and add when two addi do not reach
+static void adjustStack(AssemblyNode *&tail, int size) {
+    if (isImm12(size)) {
+        linkToTail(tail, new BinaryImmAssembly(Register(2), Register(2), ImmAssembly(size), "+"));
+    } else if (isImm12(size / 2) && isImm12(size - size / 2)) {
+        linkToTail(tail, new BinaryImmAssembly(Register(2), Register(2), ImmAssembly(size / 2), "+"));
+        linkToTail(tail, new BinaryImmAssembly(Register(2), Register(2), ImmAssembly(size - size / 2), "+"));
+    } else {
+        linkToTail(tail, new Li(Register(FRAME_SCRATCH), ImmAssembly(size)));
+        linkToTail(tail, new BinaryAssembly(Register(2), Register(2), Register(FRAME_SCRATCH), "+"));
+    }
+}
+
+static void renameIdent(Identifier &ident, std::string from, std::string to) {
+    if (ident.ident == from) {
+        ident.ident = to;
+    }
+}
+
 int GenerateTable::insertStack(std::string ident, int size) {
     if (identStackOffset.find(ident) != identStackOffset.end()) {
         return 0;
@@ -51,11 +109,10 @@ Register GenerateTable::allocateReg(std::string ident, AssemblyNode *&tail, bool
         if (needLoad && (regState[identReg[ident]] & 1) == 0) {
             assert(identStackOffset.find(ident) != identStackOffset.end());
             if (arraySet.find(ident) != arraySet.end()) {
-                linkToTail(tail, new BinaryImmAssembly(Register(identReg[ident]), Register(2),
-                                                       ImmAssembly(getStackOffset(ident)), "+"));
+                addressStack(tail, Register(identReg[ident]), getStackOffset(ident));
 
             } else {
-                linkToTail(tail, new Lw(Register(identReg[ident]), Register(2), getStackOffset(ident)));
+                loadStack(tail, Register(identReg[ident]), getStackOffset(ident));
             }
         }
         regState[identReg[ident]] |= 1;
@@ -66,9 +123,10 @@ Register GenerateTable::allocateReg(std::string ident, AssemblyNode *&tail, bool
     if (identStackOffset.find(ident) == identStackOffset.end()) {  // the ident is not used
         return Register(0);
     }
-    // find in cache
+    // find in cache, in use until freed like a newly loaded one
     for (auto i = 0ull; i < TEMP_REGISTERS.size(); ++i) {
         if (tempReg[i] == ident) {
+            regState[TEMP_REGISTERS[i]] |= 1;
             return Register(TEMP_REGISTERS[i]);
         }
     }
@@ -79,11 +137,10 @@ Register GenerateTable::allocateReg(std::string ident, AssemblyNode *&tail, bool
             regState[reg] |= 1;
             tempReg[i] = ident;
             if (arraySet.find(ident) != arraySet.end()) {
-                linkToTail(tail,
-                           new BinaryImmAssembly(Register(reg), Register(2), ImmAssembly(getStackOffset(ident)), "+"));
+                addressStack(tail, Register(reg), getStackOffset(ident));
             } else {
                 if (needLoad) {
-                    linkToTail(tail, new Lw(Register(reg), Register(2), getStackOffset(ident)));
+                    loadStack(tail, Register(reg), getStackOffset(ident));
                 }
             }
             return Register(reg);
@@ -97,11 +154,10 @@ Register GenerateTable::allocateReg(std::string ident, AssemblyNode *&tail, bool
             regState[reg] |= 1;
             tempReg[i] = ident;
             if (arraySet.find(ident) != arraySet.end()) {
-                linkToTail(tail,
-                           new BinaryImmAssembly(Register(reg), Register(2), ImmAssembly(getStackOffset(ident)), "+"));
+                addressStack(tail, Register(reg), getStackOffset(ident));
             } else {
                 if (needLoad) {
-                    linkToTail(tail, new Lw(Register(reg), Register(2), getStackOffset(ident)));
+                    loadStack(tail, Register(reg), getStackOffset(ident));
                 }
             }
             lastVictim = i;
@@ -111,6 +167,39 @@ Register GenerateTable::allocateReg(std::string ident, AssemblyNode *&tail, bool
     throw std::runtime_error("No available register");
 }
 
+Register GenerateTable::allocateScratch(AssemblyNode *&tail) {
+    const std::string SCRATCH = "_scratch";
+    for (auto i = 0ull; i < TEMP_REGISTERS.size(); ++i) {
+        if (tempReg[i].empty()) {
+            regState[TEMP_REGISTERS[i]] |= 1;
+            tempReg[i] = SCRATCH;
+            return Register(TEMP_REGISTERS[i]);
+        }
+    }
+    for (auto i = (lastVictim + 1) % TEMP_REGISTERS.size(); i != lastVictim; i = (i + 1) % TEMP_REGISTERS.size()) {
+        int reg = TEMP_REGISTERS[i];
+        if ((regState[reg] & 1) == 0) {
+            clear(Register(reg), tail);
+            regState[reg] |= 1;
+            tempReg[i] = SCRATCH;
+            lastVictim = i;
+            return Register(reg);
+        }
+    }
+    throw std::runtime_error("No available register");
+}
+
+const std::unordered_set<int> &GenerateTable::getClobbers(std::string func) {
+    // a callee not generated yet is in the same recursive cycle, which follows the standard convention
+    static const std::unordered_set<int> standard = [] {
+        std::unordered_set<int> regs(TEMP_REGISTERS.begin(), TEMP_REGISTERS.end());
+        regs.insert(ARG_REGISTERS.begin(), ARG_REGISTERS.end());
+        return regs;
+    }();
+    auto it = clobbers.find(func);
+    return it != clobbers.end() ? it->second : standard;
+}
+
 void GenerateTable::free(std::string ident, Register reg, AssemblyNode *&tail, bool needStore) {
     // only free temp registers
     if (std::find(TEMP_REGISTERS.begin(), TEMP_REGISTERS.end(), reg.index) != TEMP_REGISTERS.end()) {
@@ -128,7 +217,7 @@ void GenerateTable::clear(Register reg, AssemblyNode *&tail) {
         }
         if (regState[reg.index] & 0b10) {
             assert(identStackOffset.find(ident) != identStackOffset.end());
-            linkToTail(tail, new Sw(reg, Register(2), getStackOffset(ident)));
+            storeStack(tail, reg, getStackOffset(ident));
         }
         regState[reg.index] = 0;
         tempReg[tempIndex] = "";
@@ -161,22 +250,42 @@ bool IRNode::_livenessAnalysis(IRNode *next, IRNode *second) {
 void LoadImm::print() { printToFile(immediateFile, "%s = #%d\n", ident.ident.c_str(), value.value); }
 
 void LoadImm::generate(GenerateTable *table, AssemblyNode *&tail) {
+    if (table->zeroIdents.find(ident.ident) != table->zeroIdents.end()) {
+        return;
+    }
     Register reg = table->allocateReg(ident.ident, tail, false);
     linkToTail(tail, new Li(reg, ImmAssembly(value.value)));
     table->free(ident.ident, reg, tail, true);
 }
 
+void LoadImm::renameDef(std::string from, std::string to) {
+    renameIdent(ident, from, to);
+    def = {ident.ident};
+}
+
 void Assign::print() { printToFile(immediateFile, "%s = %s\n", lhs.ident.c_str(), rhs.ident.c_str()); }
 
 void Assign::generate(GenerateTable *table, AssemblyNode *&tail) {
     // 此处均需先分配需要load的变量，再分配无需load的变量。否则在lhs和rhs相同时会导致rhs没有load
     Register rhsReg = table->allocateReg(rhs.ident, tail, true);
     Register lhsReg = table->allocateReg(lhs.ident, tail, false);
-    linkToTail(tail, new Mv(lhsReg, rhsReg));
+    if (lhsReg.index != rhsReg.index) {
+        linkToTail(tail, new Mv(lhsReg, rhsReg));
+    }
     table->free(lhs.ident, lhsReg, tail, true);
     table->free(rhs.ident, rhsReg, tail, false);
 }
 
+void Assign::renameUse(std::string from, std::string to) {
+    renameIdent(rhs, from, to);
+    use = {rhs.ident};
+}
+
+void Assign::renameDef(std::string from, std::string to) {
+    renameIdent(lhs, from, to);
+    def = {lhs.ident};
+}
+
 void Binop::print() {
     printToFile(immediateFile, "%s = %s %s %s\n", lhs.ident.c_str(), rhs1.ident.c_str(), op.c_str(),
                 rhs2.ident.c_str());
@@ -186,24 +295,270 @@ void Binop::generate(GenerateTable *table, AssemblyNode *&tail) {
     Register rhs1Reg = table->allocateReg(rhs1.ident, tail, true);
     Register rhs2Reg = table->allocateReg(rhs2.ident, tail, true);
     Register lhsReg = table->allocateReg(lhs.ident, tail, false);
-    linkToTail(tail, new BinaryAssembly(lhsReg, rhs1Reg, rhs2Reg, op));
+    // relational operators are materialized without branches
+    if (op == "<") {
+        linkToTail(tail, new CompareAssembly(lhsReg, rhs1Reg, rhs2Reg, "slt"));
+    } else if (op == ">") {
+        linkToTail(tail, new CompareAssembly(lhsReg, rhs2Reg, rhs1Reg, "slt"));
+    } else if (op == "<=") {
+        linkToTail(tail, new CompareAssembly(lhsReg, rhs2Reg, rhs1Reg, "slt"));
+        linkToTail(tail, new BinaryImmAssembly(lhsReg, lhsReg, ImmAssembly(1), "^"));
+    } else if (op == ">=") {
+        linkToTail(tail, new CompareAssembly(lhsReg, rhs1Reg, rhs2Reg, "slt"));
+        linkToTail(tail, new BinaryImmAssembly(lhsReg, lhsReg, ImmAssembly(1), "^"));
+    } else if (op == "==" || op == "!=") {
+        linkToTail(tail, new CompareAssembly(lhsReg, rhs1Reg, rhs2Reg, "xor"));
+        linkToTail(tail, new SetAssembly(lhsReg, lhsReg, op == "==" ? "seqz" : "snez"));
+    } else {
+        linkToTail(tail, new BinaryAssembly(lhsReg, rhs1Reg, rhs2Reg, op));
+    }
     table->free(lhs.ident, lhsReg, tail, true);
     table->free(rhs1.ident, rhs1Reg, tail, false);
     table->free(rhs2.ident, rhs2Reg, tail, false);
 }
 
+void Binop::renameUse(std::string from, std::string to) {
+    renameIdent(rhs1, from, to);
+    renameIdent(rhs2, from, to);
+    use = {rhs1.ident, rhs2.ident};
+}
+
+void Binop::renameDef(std::string from, std::string to) {
+    renameIdent(lhs, from, to);
+    def = {lhs.ident};
+}
+
 void BinopImm::print() {
     printToFile(immediateFile, "%s = %s %s #%d\n", lhs.ident.c_str(), rhs.ident.c_str(), op.c_str(), imm.value);
 }
 
+// magic multiplier and shift for signed division by a constant (Hacker's Delight, 10-1)
+static void signedMagic(int divisor, int &multiplier, int &shift) {
+    const unsigned int two31 = 0x80000000u;
+    unsigned int ad = divisor < 0 ? -static_cast<unsigned int>(divisor) : divisor;
+    unsigned int t = two31 + (static_cast<unsigned int>(divisor) >> 31);
+    unsigned int anc = t - 1 - t % ad;
+    unsigned int q1 = two31 / anc, r1 = two31 - q1 * anc;
+    unsigned int q2 = two31 / ad, r2 = two31 - q2 * ad;
+    unsigned int delta;
+    int p = 31;
+    do {
+        ++p;
+        q1 *= 2, r1 *= 2;
+        if (r1 >= anc) ++q1, r1 -= anc;
+        q2 *= 2, r2 *= 2;
+        if (r2 >= ad) ++q2, r2 -= ad;
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+    multiplier = static_cast<int>(divisor < 0 ? -(q2 + 1) : q2 + 1);
+    shift = p - 32;
+}
+
+static bool isPowerOfTwo(long long value) { return value > 0 && (value & (value - 1)) == 0; }
+
+// dst = src * value, using shifts and adds when the constant has a short binary form
+static void generateMulImm(GenerateTable *table, AssemblyNode *&tail, Register dst, Register src, int value) {
+    long long magnitude = std::llabs(static_cast<long long>(value));
+    long long low = magnitude & -magnitude;
+    int lowShift = __builtin_ctzll(low);
+    Register scratch(0);
+    if (magnitude == 0) {
+        linkToTail(tail, new Mv(dst, Register(0)));
+        return;
+    } else if (magnitude == low) {
+        // 2^a
+        if (lowShift == 0) {
+            linkToTail(tail, new Mv(dst, src));
+        } else {
+            linkToTail(tail, new BinaryImmAssembly(dst, src, ImmAssembly(lowShift), "<<"));
+        }
+    } else if (isPowerOfTwo(magnitude - low) || (isPowerOfTwo(magnitude + low) && magnitude + low <= 0x80000000ll)) {
+        // 2^b + 2^a or 2^b - 2^a, the high term goes to the scratch register first so that dst may alias src
+        bool add = isPowerOfTwo(magnitude - low);
+        int highShift = __builtin_ctzll(add ? magnitude - low : magnitude + low);
+        scratch = table->allocateScratch(tail);
+        linkToTail(tail, new BinaryImmAssembly(scratch, src, ImmAssembly(highShift & 31), "<<"));
+        Register lowReg = src;
+        if (lowShift != 0) {
+            linkToTail(tail, new BinaryImmAssembly(dst, src, ImmAssembly(lowShift), "<<"));
+            lowReg = dst;
+        }
+        linkToTail(tail, new BinaryAssembly(dst, scratch, lowReg, add ? "+" : "-"));
+    } else {
+        scratch = table->allocateScratch(tail);
+        linkToTail(tail, new Li(scratch, ImmAssembly(value)));
+        linkToTail(tail, new BinaryAssembly(dst, src, scratch, "*"));
+        table->clear(scratch, tail);
+        return;
+    }
+    if (value < 0) {
+        linkToTail(tail, new BinaryAssembly(dst, Register(0), dst, "-"));
+    }
+    table->clear(scratch, tail);
+}
+
+// dst = src + (src < 0 ? 2^shift - 1 : 0), the bias that makes an arithmetic shift round toward zero
+static void generateRoundingBias(AssemblyNode *&tail, Register dst, Register src, int shift) {
+    if (shift == 1) {
+        linkToTail(tail, new BinaryImmAssembly(dst, src, ImmAssembly(31), ">>>"));
+    } else {
+        linkToTail(tail, new BinaryImmAssembly(dst, src, ImmAssembly(31), ">>"));
+        linkToTail(tail, new BinaryImmAssembly(dst, dst, ImmAssembly(32 - shift), ">>>"));
+    }
+    linkToTail(tail, new BinaryAssembly(dst, src, dst, "+"));
+}
+
+// dst = src / value with C truncation, without a div instruction
+static void generateDivImm(GenerateTable *table, AssemblyNode *&tail, Register dst, Register src, int value) {
+    if (value == 1 || value == -1) {
+        linkToTail(tail, value == 1 ? static_cast<AssemblyNode *>(new Mv(dst, src))
+                                    : new BinaryAssembly(dst, Register(0), src, "-"));
+        return;
+    }
+    Register scratch = table->allocateScratch(tail);
+    if (value == INT_MIN) {
+        linkToTail(tail, new Li(scratch, ImmAssembly(value)));
+        linkToTail(tail, new BinaryAssembly(dst, src, scratch, "/"));
+        table->clear(scratch, tail);
+        return;
+    }
+    long long magnitude = std::llabs(static_cast<long long>(value));
+    if (isPowerOfTwo(magnitude)) {
+        int shift = __builtin_ctzll(magnitude);
+        generateRoundingBias(tail, scratch, src, shift);
+        linkToTail(tail, new BinaryImmAssembly(dst, scratch, ImmAssembly(shift), ">>"));
+        if (value < 0) {
+            linkToTail(tail, new BinaryAssembly(dst, Register(0), dst, "-"));
+        }
+    } else {
+        int multiplier, shift;
+        signedMagic(value, multiplier, shift);
+        linkToTail(tail, new Li(scratch, ImmAssembly(multiplier)));
+        linkToTail(tail, new BinaryAssembly(scratch, src, scratch, "mulh"));
+        if (value > 0 && multiplier < 0) {
+            linkToTail(tail, new BinaryAssembly(scratch, scratch, src, "+"));
+        } else if (value < 0 && multiplier > 0) {
+            linkToTail(tail, new BinaryAssembly(scratch, scratch, src, "-"));
+        }
+        if (shift > 0) {
+            linkToTail(tail, new BinaryImmAssembly(scratch, scratch, ImmAssembly(shift), ">>"));
+        }
+        // add one to a negative quotient
+        linkToTail(tail, new BinaryImmAssembly(dst, scratch, ImmAssembly(31), ">>>"));
+        linkToTail(tail, new BinaryAssembly(dst, scratch, dst, "+"));
+    }
+    table->clear(scratch, tail);
+}
+
+// dst = src % value, as src - src / value * value
+static void generateRemImm(GenerateTable *table, AssemblyNode *&tail, Register dst, Register src, int value) {
+    if (value == 1 || value == -1) {
+        linkToTail(tail, new Mv(dst, Register(0)));
+        return;
+    }
+    Register scratch = table->allocateScratch(tail);
+    long long magnitude = std::llabs(static_cast<long long>(value));
+    if (value == INT_MIN) {
+        linkToTail(tail, new Li(scratch, ImmAssembly(value)));
+        linkToTail(tail, new BinaryAssembly(dst, src, scratch, "%"));
+    } else if (isPowerOfTwo(magnitude)) {
+        // the sign of the divisor does not matter, clear the low bits of the biased value
+        int shift = __builtin_ctzll(magnitude);
+        generateRoundingBias(tail, scratch, src, shift);
+        if (isImm12(-magnitude)) {
+            linkToTail(tail, new BinaryImmAssembly(scratch, scratch, ImmAssembly(-magnitude), "&"));
+        } else {
+            linkToTail(tail, new BinaryImmAssembly(scratch, scratch, ImmAssembly(shift), ">>"));
+            linkToTail(tail, new BinaryImmAssembly(scratch, scratch, ImmAssembly(shift), "<<"));
+        }
+        linkToTail(tail, new BinaryAssembly(dst, src, scratch, "-"));
+    } else {
+        generateDivImm(table, tail, scratch, src, value);
+        generateMulImm(table, tail, scratch, scratch, value);
+        linkToTail(tail, new BinaryAssembly(dst, src, scratch, "-"));
+    }
+    table->clear(scratch, tail);
+}
+
 void BinopImm::generate(GenerateTable *table, AssemblyNode *&tail) {
     Register rhsReg = table->allocateReg(rhs.ident, tail, true);
     Register lhsReg = table->allocateReg(lhs.ident, tail, false);
-    linkToTail(tail, new BinaryImmAssembly(lhsReg, rhsReg, ImmAssembly(imm.value), op));
+    long long value = imm.value;
+    // the immediate in a register, for the forms without an I-type instruction
+    auto loadImm = [&](long long value) {
+        Register reg = table->allocateScratch(tail);
+        linkToTail(tail, new Li(reg, ImmAssembly(value)));
+        return reg;
+    };
+    Register scratch(0);
+    if (op == "+" || op == "-") {
+        long long addend = op == "-" ? -value : value;
+        if (isImm12(addend)) {
+            linkToTail(tail, new BinaryImmAssembly(lhsReg, rhsReg, ImmAssembly(addend), "+"));
+        } else {
+            scratch = loadImm(value);
+            linkToTail(tail, new BinaryAssembly(lhsReg, rhsReg, scratch, op));
+        }
+    } else if (op == "*") {
+        generateMulImm(table, tail, lhsReg, rhsReg, value);
+    } else if (op == "/") {
+        generateDivImm(table, tail, lhsReg, rhsReg, value);
+    } else if (op == "%") {
+        generateRemImm(table, tail, lhsReg, rhsReg, value);
+    } else if (op == "<" || op == ">=") {
+        if (isImm12(value)) {
+            linkToTail(tail, new BinaryImmAssembly(lhsReg, rhsReg, ImmAssembly(value), "<"));
+        } else {
+            scratch = loadImm(value);
+            linkToTail(tail, new CompareAssembly(lhsReg, rhsReg, scratch, "slt"));
+        }
+        if (op == ">=") {
+            linkToTail(tail, new BinaryImmAssembly(lhsReg, lhsReg, ImmAssembly(1), "^"));
+        }
+    } else if (op == ">" || op == "<=") {
+        // x <= c is x < c + 1
+        if (isImm12(value + 1)) {
+            linkToTail(tail, new BinaryImmAssembly(lhsReg, rhsReg, ImmAssembly(value + 1), "<"));
+            if (op == ">") {
+                linkToTail(tail, new BinaryImmAssembly(lhsReg, lhsReg, ImmAssembly(1), "^"));
+            }
+        } else {
+            scratch = loadImm(value);
+            linkToTail(tail, new CompareAssembly(lhsReg, scratch, rhsReg, "slt"));
+            if (op == "<=") {
+                linkToTail(tail, new BinaryImmAssembly(lhsReg, lhsReg, ImmAssembly(1), "^"));
+            }
+        }
+    } else if (op == "==" || op == "!=") {
+        if (value == 0) {
+            linkToTail(tail, new SetAssembly(lhsReg, rhsReg, op == "==" ? "seqz" : "snez"));
+        } else {
+            if (isImm12(value)) {
+                linkToTail(tail, new BinaryImmAssembly(lhsReg, rhsReg, ImmAssembly(value), "^"));
+            } else {
+                scratch = loadImm(value);
+                linkToTail(tail, new CompareAssembly(lhsReg, rhsReg, scratch, "xor"));
+            }
+            linkToTail(tail, new SetAssembly(lhsReg, lhsReg, op == "==" ? "seqz" : "snez"));
+        }
+    } else {
+        throw std::runtime_error("Invalid binary operator");
+    }
+    table->clear(scratch, tail);
     table->free(lhs.ident, lhsReg, tail, true);
     table->free(rhs.ident, rhsReg, tail, false);
 }
 
+void BinopImm::renameUse(std::string from, std::string to) {
+    renameIdent(rhs, from, to);
+    use = {rhs.ident};
+}
+
+void BinopImm::renameDef(std::string from, std::string to) {
+    renameIdent(lhs, from, to);
+    def = {lhs.ident};
+}
+
 void Unop::print() { printToFile(immediateFile, "%s = %s%s\n", lhs.ident.c_str(), op.c_str(), rhs.ident.c_str()); }
 
 void Unop::generate(GenerateTable *table, AssemblyNode *&tail) {
@@ -216,6 +571,9 @@ void Unop::generate(GenerateTable *table, AssemblyNode *&tail) {
         case '-':
             linkToTail(tail, new BinaryAssembly(lhsReg, Register(0), rhsReg, "-"));
             break;
+        case '!':
+            linkToTail(tail, new SetAssembly(lhsReg, rhsReg, "seqz"));
+            break;
         default:
             throw std::runtime_error("Invalid unary operator");
     }
@@ -223,6 +581,16 @@ void Unop::generate(GenerateTable *table, AssemblyNode *&tail) {
     table->free(rhs.ident, rhsReg, tail, false);
 }
 
+void Unop::renameUse(std::string from, std::string to) {
+    renameIdent(rhs, from, to);
+    use = {rhs.ident};
+}
+
+void Unop::renameDef(std::string from, std::string to) {
+    renameIdent(lhs, from, to);
+    def = {lhs.ident};
+}
+
 void Load::print() { printToFile(immediateFile, "%s = *%s\n", lhs.ident.c_str(), rhs.ident.c_str()); }
 
 void Load::generate(GenerateTable *table, AssemblyNode *&tail) {
@@ -233,6 +601,16 @@ void Load::generate(GenerateTable *table, AssemblyNode *&tail) {
     table->free(rhs.ident, rhsReg, tail, false);
 }
 
+void Load::renameUse(std::string from, std::string to) {
+    renameIdent(rhs, from, to);
+    use = {rhs.ident};
+}
+
+void Load::renameDef(std::string from, std::string to) {
+    renameIdent(lhs, from, to);
+    def = {lhs.ident};
+}
+
 void Store::print() { printToFile(immediateFile, "*%s = %s\n", lhs.ident.c_str(), rhs.ident.c_str()); }
 
 void Store::generate(GenerateTable *table, AssemblyNode *&tail) {
@@ -243,24 +621,89 @@ void Store::generate(GenerateTable *table, AssemblyNode *&tail) {
     table->free(rhs.ident, rhsReg, tail, false);
 }
 
+void Store::renameUse(std::string from, std::string to) {
+    renameIdent(lhs, from, to);
+    renameIdent(rhs, from, to);
+    use = {lhs.ident, rhs.ident};
+}
+
 static void saveTemp(GenerateTable *table, AssemblyNode *&tail) {
     for (int i : TEMP_REGISTERS) {
         table->clear(Register(i), tail);
     }
 }
 
+// store the dirty temp registers whose values are still live, forget the dead ones
+static void writeBackTemp(GenerateTable *table, const std::unordered_set<std::string> &live, AssemblyNode *&tail) {
+    for (auto i = 0ull; i < TEMP_REGISTERS.size(); ++i) {
+        int reg = TEMP_REGISTERS[i];
+        if (table->tempReg[i].empty() || (table->regState[reg] & 0b10) == 0) {
+            continue;
+        }
+        if (live.find(table->tempReg[i]) != live.end()) {
+            storeStack(tail, Register(reg), table->getStackOffset(table->tempReg[i]));
+            table->regState[reg] &= ~0b10;
+        } else {
+            table->regState[reg] = 0;
+            table->tempReg[i] = "";
+        }
+    }
+}
+
+// leave the temp registers as the edge into `label` expects them. A label only reached from here gets them as they
+// are and a merge point gets them stored. A loop header gets them empty, as its back edges are generated after it
+// and scratch values would evict whatever it kept on the way round
+static void branchTemp(GenerateTable *table, std::string label, const std::unordered_set<std::string> &live,
+                       AssemblyNode *&tail) {
+    if (table->loopHeaders.find(label) != table->loopHeaders.end()) {
+        writeBackTemp(table, live, tail);
+        saveTemp(table, tail);
+        return;
+    }
+    if (table->labelPreds[label] > 1) {
+        writeBackTemp(table, live, tail);
+    }
+    std::vector<std::pair<std::string, short>> state;
+    for (auto i = 0ull; i < TEMP_REGISTERS.size(); ++i) {
+        state.emplace_back(table->tempReg[i], table->regState[TEMP_REGISTERS[i]] & 0b10);
+    }
+    table->labelTemps[label].push_back(state);
+}
+
 void Label::print() { printToFile(immediateFile, "LABEL %s:\n", name.c_str()); }
 
 void Label::generate(GenerateTable *table, AssemblyNode *&tail) {
-    saveTemp(table, tail);
+    // the code falling through is one more edge
+    auto &states = table->labelTemps[name];
+    if (table->loopHeaders.find(name) != table->loopHeaders.end() ||
+        static_cast<int>(states.size()) < table->labelPreds[name]) {
+        branchTemp(table, name, in, tail);
+    }
+    // keep the values every edge agrees on, a dirty one can only come along a single edge
+    for (auto i = 0ull; i < TEMP_REGISTERS.size(); ++i) {
+        std::string ident = states.empty() ? "" : states[0][i].first;
+        for (auto &state : states) {
+            if (state[i].first != ident) {
+                ident = "";
+            }
+        }
+        table->tempReg[i] = ident;
+        table->regState[TEMP_REGISTERS[i]] = ident.empty() ? 0 : states[0][i].second;
+    }
+    table->labelTemps.erase(name);
     linkToTail(tail, new LabelAssembly(name));
 }
 
 void Goto::print() { printToFile(immediateFile, "GOTO %s\n", label.c_str()); }
 
 void Goto::generate(GenerateTable *table, AssemblyNode *&tail) {
-    saveTemp(table, tail);
+    branchTemp(table, label, in, tail);
     linkToTail(tail, new J(label));
+    // nothing falls through
+    for (auto i = 0ull; i < TEMP_REGISTERS.size(); ++i) {
+        table->tempReg[i] = "";
+        table->regState[TEMP_REGISTERS[i]] = 0;
+    }
 }
 
 void CondGoto::print() {
@@ -271,12 +714,24 @@ void CondGoto::print() {
 void CondGoto::generate(GenerateTable *table, AssemblyNode *&tail) {
     Register lhsReg = table->allocateReg(lhs.ident, tail, true);
     Register rhsReg = table->allocateReg(rhs.ident, tail, true);
-    saveTemp(table, tail);
+    branchTemp(table, label, out, tail);
     linkToTail(tail, new Branch(lhsReg, rhsReg, label, op));
     table->free(lhs.ident, lhsReg, tail, false);
     table->free(rhs.ident, rhsReg, tail, false);
 }
 
+void CondGoto::invert() {
+    static const std::unordered_map<std::string, std::string> inverse = {{"<", ">="}, {">=", "<"}, {">", "<="},
+                                                                         {"<=", ">"}, {"==", "!="}, {"!=", "=="}};
+    op = inverse.at(op);
+}
+
+void CondGoto::renameUse(std::string from, std::string to) {
+    renameIdent(lhs, from, to);
+    renameIdent(rhs, from, to);
+    use = {lhs.ident, rhs.ident};
+}
+
 void FuncDefNode::print() { printToFile(immediateFile, "FUNCTION %s:\n", name.ident.c_str()); }
 
 static void livenessAnalysisFunc(GenerateTable *table, std::vector<IRNode *> &nodes, FuncDefNode *func) {
@@ -336,65 +791,557 @@ static void livenessAnalysisFunc(GenerateTable *table, std::vector<IRNode *> &no
     }
 }
 
+// times each node ran in the profile run, or without a profile 8^depth of the loops around it,
+// loops found as backward branches in the layout
+static std::vector<long long> nodeWeights(GenerateTable *table, std::vector<IRNode *> &nodes) {
+    std::vector<long long> weight(nodes.size(), 1);
+    if (std::any_of(nodes.begin(), nodes.end(), [](IRNode *node) { return node->count >= 0; })) {
+        // nodes added by the optimizer have no count, they run as often as the node before them
+        long long count = 1;
+        for (auto i = 0ull; i < nodes.size(); ++i) {
+            count = nodes[i]->count >= 0 ? nodes[i]->count : count;
+            weight[i] = count;
+        }
+        return weight;
+    }
+    // the last node branching back to each loop header
+    std::vector<int> loopEnd(nodes.size(), -1), depth(nodes.size() + 1, 0);
+    for (auto i = 0ull; i < nodes.size(); ++i) {
+        std::string label;
+        if (typeid(*nodes[i]) == typeid(Goto)) {
+            label = static_cast<Goto *>(nodes[i])->getLabel();
+        } else if (typeid(*nodes[i]) == typeid(CondGoto)) {
+            label = static_cast<CondGoto *>(nodes[i])->getLabel();
+        } else {
+            continue;
+        }
+        auto it = table->labelMap.find(label);
+        if (it != table->labelMap.end() && it->second->index <= static_cast<int>(i)) {
+            loopEnd[it->second->index] = std::max(loopEnd[it->second->index], static_cast<int>(i));
+        }
+    }
+    for (auto i = 0ull; i < nodes.size(); ++i) {
+        if (loopEnd[i] >= 0) {
+            ++depth[i];
+            --depth[loopEnd[i] + 1];
+        }
+    }
+    for (int i = 0, d = 0; i < static_cast<int>(nodes.size()); ++i) {
+        d += depth[i];
+        weight[i] = 1ll << std::min(3 * d, 15);
+    }
+    return weight;
+}
+
+/*
+带生命期空洞的线性扫描 (binpacking). 区间由变量活跃的若干段组成, 每个寄存器记录已放入的段,
+新区间的每一段都不与之重叠即可放入, 所以一个变量生命期空洞中的寄存器可以给别的变量.
+可分配 a0-a7 和 s0-s11: 不跨越调用的变量优先放在调用本来就会破坏的参数寄存器, 跨越调用的变量优先放在
+被跨越的调用不破坏的寄存器, 否则由调用者在调用前后保存恢复, 相当于在调用处分割区间. ARG 写入的参数寄存器
+直到调用都被占用. 调用和使用都按循环深度 (有 profile 时按执行次数) 加权: 跨越调用的代价是每次调用的保存恢复,
+新用一个 s 寄存器的代价是每次进入函数的保存恢复. 参数默认留在传入的寄存器, 跨越的调用 (如循环中的调用)
+代价更高时才和其他变量一样分配, 在入口移入. 放不下时, 若某个寄存器上只有一个与之冲突的区间且它的
+溢出代价/长度更小, 溢出那个区间, 否则溢出当前区间, 所以溢出的是循环中少用的变量. 溢出的变量每次使用时
+装入临时寄存器, 在基本块内留在其中.
+*/
 static void linearScan(GenerateTable *table, std::vector<IRNode *> &nodes, FuncDefNode *func) {
+    // an ident live out of node i occupies [i, i + 1)
     table->varIntervals.clear();
     for (auto i = 0ull; i < nodes.size(); ++i) {
         for (auto ident : nodes[i]->out) {
-            if (table->varIntervals.find(ident) == table->varIntervals.end()) {
-                table->varIntervals[ident] = VarInterval(ident, i, i + 1);
+            auto it = table->varIntervals.find(ident);
+            if (it == table->varIntervals.end()) {
+                it = table->varIntervals.emplace(ident, VarInterval(ident, i, i + 1)).first;
+                it->second.ranges.emplace_back(i, i + 1);
+            } else if (it->second.ranges.back().second == static_cast<int>(i)) {
+                it->second.ranges.back().second = it->second.end = i + 1;
             } else {
-                table->varIntervals[ident].end = i + 1;
+                it->second.ranges.emplace_back(i, i + 1);
+                it->second.end = i + 1;
             }
         }
     }
+    // registers the parameters arrive in
+    std::unordered_map<std::string, int> incoming(table->identReg.begin(), table->identReg.end());
+    // addresses of arrays are computed in the prologue and parameters arrive in registers, before any node
+    std::unordered_set<std::string> fromEntry(table->arraySet.begin(), table->arraySet.end());
+    for (auto &reg : incoming) {
+        fromEntry.insert(reg.first);
+    }
+    if (!nodes.empty()) {
+        fromEntry.insert(nodes[0]->in.begin(), nodes[0]->in.end());
+    }
+    for (auto &ident : fromEntry) {
+        auto it = table->varIntervals.find(ident);
+        if (it != table->varIntervals.end()) {
+            it->second.start = it->second.ranges.front().first = -1;
+        }
+    }
 
-    table->live.clear();
-    std::map<VarInterval, int, std::greater<VarInterval>> active;
-    std::unordered_set<int> freeRegisters;
-    for (auto i : SAVED_REGISTERS) {
-        freeRegisters.insert(i);
+    std::vector<VarInterval> intervals;
+    for (auto &interval : table->varIntervals) {
+        intervals.emplace_back(interval.second);
+    }
+    std::sort(intervals.begin(), intervals.end());
+
+    // the pieces placed in each register: start -> end and ident, an empty ident cannot be moved
+    std::unordered_map<int, std::map<int, std::pair<int, std::string>>> occupied;
+    auto place = [&](int reg, const VarInterval &interval, const std::string &owner) {
+        auto &pieces = occupied[reg];
+        for (auto range : interval.ranges) {
+            // fixed pieces may overlap each other, they are merged to keep the pieces disjoint
+            auto it = pieces.upper_bound(range.first);
+            if (owner.empty() && it != pieces.begin() && std::prev(it)->second.first >= range.first) {
+                --it;
+            }
+            while (owner.empty() && it != pieces.end() && it->first <= range.second) {
+                range = {std::min(range.first, it->first), std::max(range.second, it->second.first)};
+                it = pieces.erase(it);
+            }
+            pieces[range.first] = {range.second, owner};
+        }
+    };
+    // idents holding the register somewhere in the interval
+    auto owners = [&](int reg, const VarInterval &interval) {
+        std::unordered_set<std::string> result;
+        auto &pieces = occupied[reg];
+        for (auto &range : interval.ranges) {
+            auto it = pieces.upper_bound(range.first);
+            if (it != pieces.begin() && std::prev(it)->second.first > range.first) {
+                --it;
+            }
+            for (; it != pieces.end() && it->first < range.second; ++it) {
+                result.insert(it->second.second);
+            }
+        }
+        return result;
+    };
+    // argument registers are taken from each ARG to its call
+    std::vector<int> args;
+    for (auto cur : nodes) {
+        if (typeid(*cur) == typeid(Arg)) {
+            args.push_back(cur->index);
+        } else if (typeid(*cur) == typeid(Call) || typeid(*cur) == typeid(CallWithRet)) {
+            for (auto k = 0ull; k < args.size() && k < ARG_REGISTERS.size(); ++k) {
+                VarInterval block("", args[k], cur->index);
+                block.ranges.emplace_back(args[k], cur->index);
+                place(ARG_REGISTERS[k], block, "");
+            }
+            args.clear();
+        }
+    }
+
+    // the calls each ident lives across with how often they run, and registers the function modifies anyway
+    std::vector<long long> weight = nodeWeights(table, nodes);
+    std::unordered_map<std::string, std::vector<std::pair<const std::unordered_set<int> *, long long>>> crossed;
+    std::unordered_set<int> used(ARG_REGISTERS.begin(), ARG_REGISTERS.end());
+    // every entry of a recursive function comes from a call, so it runs as often as its calls into the cycle
+    long long entry = nodes.empty() ? 1 : weight[0], cycle = 0;
+    for (auto cur : nodes) {
+        if (typeid(*cur) == typeid(Call) || typeid(*cur) == typeid(CallWithRet)) {
+            CallNode *call = static_cast<CallNode *>(cur);
+            if (table->clobbers.find(call->getName()) == table->clobbers.end()) {
+                cycle += weight[cur->index];
+            }
+            const std::unordered_set<int> &clobbers = table->getClobbers(call->getName());
+            for (auto &ident : cur->out) {
+                if (ident != call->getLhs().ident) {
+                    crossed[ident].emplace_back(&clobbers, weight[cur->index]);
+                }
+            }
+            used.insert(clobbers.begin(), clobbers.end());
+        }
     }
-    for (auto interval : table->varIntervals) {
-        table->live.emplace_back(interval.second);
+    entry = std::max(entry, cycle);
+    // a parameter stays where it arrives, saved around the calls clobbering it, unless that costs more than
+    // moving it to a register of its own, as for one crossing a call in a loop
+    for (auto &reg : incoming) {
+        auto it = table->varIntervals.find(reg.first);
+        if (it == table->varIntervals.end()) {
+            continue;
+        }
+        long long saves = 0;
+        for (auto &call : crossed[reg.first]) {
+            saves += call.first->count(reg.second) ? 2 * call.second : 0;
+        }
+        if (saves > 2 * entry) {
+            table->identReg.erase(reg.first);
+        } else {
+            place(reg.second, it->second, "");
+        }
+    }
+    // spill cost: uses and definitions weighted by loop depth or by the profile, per node the interval covers
+    std::unordered_map<std::string, long long> spillCost;
+    for (auto cur : nodes) {
+        for (auto *set : {&cur->use, &cur->def}) {
+            for (auto &ident : *set) {
+                spillCost[ident] += weight[cur->index];
+            }
+        }
     }
-    std::sort(table->live.begin(), table->live.end());
+    auto density = [&](const VarInterval &interval) {
+        int size = 0;
+        for (auto &range : interval.ranges) {
+            size += range.second - range.first;
+        }
+        return static_cast<double>(spillCost[interval.ident]) / std::max(size, 1);
+    };
+    // whether `a` should stay in a register rather than `b`
+    auto keep = [&](const VarInterval &a, const VarInterval &b) {
+        if (density(a) != density(b)) {
+            return density(a) > density(b);
+        }
+        return a.end < b.end;
+    };
+    // argument registers first, then saved registers; a call across the interval clobbering the register costs
+    // a store and a load each time it runs, a register not modified yet a store and a load on each entry
+    std::vector<int> registers(ARG_REGISTERS);
+    registers.insert(registers.end(), SAVED_REGISTERS.begin(), SAVED_REGISTERS.end());
+    auto chooseRegister = [&](const VarInterval &interval, int hint) {
+        auto &calls = crossed[interval.ident];
+        auto cost = [&](int reg) {
+            long long sum = used.count(reg) ? 0 : 2 * entry;
+            for (auto &call : calls) {
+                sum += call.first->count(reg) ? 2 * call.second : 0;
+            }
+            return sum;
+        };
+        int best = hint != -1 && owners(hint, interval).empty() ? hint : -1;
+        for (auto reg : registers) {
+            if ((best == -1 || cost(reg) < cost(best)) && owners(reg, interval).empty()) {
+                best = reg;
+            }
+        }
+        return best;
+    };
 
     // allocate registers
-    for (auto i : table->live) {
-        // if already allocated(such as function arguments)
-        if (table->identReg.find(i.ident) != table->identReg.end()) {
+    for (auto &i : intervals) {
+        // if already allocated(such as function arguments), or kept in x0
+        if (table->identReg.find(i.ident) != table->identReg.end() ||
+            table->zeroIdents.find(i.ident) != table->zeroIdents.end()) {
             continue;
         }
+        // coalesce copy: prefer the register of the source, free if its interval ends here
+        int hint = incoming.count(i.ident) ? incoming[i.ident] : -1;
+        IRNode *defNode = i.start >= 0 ? nodes[i.start] : nullptr;
+        if (defNode != nullptr && typeid(*defNode) == typeid(Assign) &&
+            static_cast<Assign *>(defNode)->getLhs().ident == i.ident) {
+            auto it = table->identReg.find(static_cast<Assign *>(defNode)->getRhs().ident);
+            hint = it != table->identReg.end() ? it->second : -1;
+        }
 
-        // expire old intervals
-        for (auto j = active.begin(); j != active.end();) {
-            if (j->first.end >= i.start) {
-                break;
+        int reg = chooseRegister(i, hint);
+        if (reg == -1) {
+            // evict an interval holding a register alone over this one, if it is the worse one to keep
+            const VarInterval *victim = nullptr;
+            for (auto r : registers) {
+                auto holders = owners(r, i);
+                if (holders.size() == 1 && !holders.begin()->empty()) {
+                    const VarInterval &holder = table->varIntervals[*holders.begin()];
+                    if (keep(i, holder) && (victim == nullptr || keep(*victim, holder))) {
+                        victim = &holder;
+                        reg = r;
+                    }
+                }
+            }
+            if (victim == nullptr) {
+                table->insertStack(i.ident, SIZE_OF_INT);
+                continue;
+            }
+            for (auto &range : victim->ranges) {
+                occupied[reg].erase(range.first);
+            }
+            table->identReg.erase(victim->ident);
+            table->insertStack(victim->ident, SIZE_OF_INT);
+        }
+        place(reg, i, i.ident);
+        used.insert(reg);
+        table->identReg[i.ident] = reg;
+    }
+    // a register holds its variable from the start, a use placed before the definition reads it as it is
+    for (auto &reg : table->identReg) {
+        table->regState[reg.second] |= 1;
+    }
+}
+
+/*
+图着色寄存器分配 (Chaitin-Briggs, 迭代合并). 冲突图的结点是变量和可分配的物理寄存器 a0-a7, s0-s11,
+参数寄存器被 ARG 写入后直到调用都被占用, 与其间活跃的变量冲突. 复制、参数、实参和返回值两端的结点按
+Briggs (变量之间) 或 George (变量与寄存器之间) 条件反复合并, 之后简化度数小于 K 的结点, 没有时按
+溢出代价/度数 最小者乐观入栈. 溢出代价是使用和定值按循环深度 (有 profile 时按执行次数) 加权的次数.
+出栈着色时优先选择跨越的调用不会破坏的寄存器, 再优先合并对象的颜色. 没有颜色的变量放在栈上,
+和线性扫描溢出的变量一样在每次使用时装入临时寄存器, 所以不需要重新构图.
+*/
+static void colorRegisters(GenerateTable *table, std::vector<IRNode *> &nodes) {
+    table->varIntervals.clear();
+    // physical registers are the first K nodes, argument registers first as any call clobbers them anyway,
+    // so the node of the i-th argument register is i
+    std::vector<int> colors(ARG_REGISTERS);
+    colors.insert(colors.end(), SAVED_REGISTERS.begin(), SAVED_REGISTERS.end());
+    const int K = colors.size();
+
+    // parameters are placed by the allocator like any other variable, not fixed in a0-a7
+    std::vector<std::string> params;
+    for (auto cur : nodes) {
+        if (typeid(*cur) == typeid(Param)) {
+            params.push_back(*cur->def.begin());
+            table->identReg.erase(params.back());
+        }
+    }
+    std::unordered_map<std::string, int> identNode;
+    std::vector<std::string> idents(K);
+    for (auto cur : nodes) {
+        for (auto *set : {&cur->use, &cur->out}) {
+            for (auto &ident : *set) {
+                if (table->zeroIdents.find(ident) == table->zeroIdents.end() &&
+                    identNode.emplace(ident, idents.size()).second) {
+                    idents.push_back(ident);
+                }
+            }
+        }
+    }
+    const int n = idents.size();
+    auto nodeOf = [&](const std::string &ident) {
+        auto it = identNode.find(ident);
+        return it == identNode.end() ? -1 : it->second;
+    };
+
+    // interference graph, spill costs, and the calls each variable lives across
+    std::vector<std::unordered_set<int>> adj(n);
+    auto addEdge = [&](int u, int v) {
+        if (u != v && u >= 0 && v >= 0 && (u >= K || v >= K)) {
+            adj[u].insert(v);
+            adj[v].insert(u);
+        }
+    };
+    struct Move {
+        int u, v;
+        long long weight;
+    };
+    std::vector<Move> moves;
+    auto addMove = [&](int u, int v, long long weight) {
+        if (u >= 0 && v >= 0) {
+            moves.push_back({u, v, weight});
+        }
+    };
+    std::vector<long long> weight = nodeWeights(table, nodes), cost(n, 0);
+    std::vector<std::vector<std::pair<const std::unordered_set<int> *, long long>>> crossed(n);
+    std::unordered_set<int> used(ARG_REGISTERS.begin(), ARG_REGISTERS.end());  // registers modified anyway
+    // variables used before any definition, such as arrays, are live together from the entry
+    if (!nodes.empty()) {
+        for (auto &a : nodes[0]->in) {
+            for (auto &b : nodes[0]->in) {
+                addEdge(nodeOf(a), nodeOf(b));
             }
-            freeRegisters.insert(j->second);
-            table->identReg[j->first.ident] = j->second;
-            j = active.erase(j);
         }
+    }
+    // the parameters arrive together, even one dead at the entry must not share a register with the others
+    for (auto &a : params) {
+        for (auto &b : params) {
+            addEdge(nodeOf(a), nodeOf(b));
+        }
+    }
+    std::vector<int> written;  // argument registers holding arguments of the next call
+    int argCount = 0, paramCount = 0;
+    for (auto i = 0ull; i < nodes.size(); ++i) {
+        IRNode *cur = nodes[i];
+        for (auto *set : {&cur->use, &cur->def}) {
+            for (auto &ident : *set) {
+                if (nodeOf(ident) >= 0) {
+                    cost[nodeOf(ident)] += weight[i];
+                }
+            }
+        }
+        // a copy does not make its ends interfere
+        std::string source = typeid(*cur) == typeid(Assign) ? static_cast<Assign *>(cur)->getRhs().ident : "";
+        for (auto &d : cur->def) {
+            for (auto &o : cur->out) {
+                if (o != source) {
+                    addEdge(nodeOf(d), nodeOf(o));
+                }
+            }
+        }
+        if (typeid(*cur) == typeid(Assign)) {
+            addMove(nodeOf(*cur->def.begin()), nodeOf(source), weight[i]);
+        } else if (typeid(*cur) == typeid(Param)) {
+            if (++paramCount <= static_cast<int>(ARG_REGISTERS.size())) {
+                addMove(nodeOf(*cur->def.begin()), paramCount - 1, weight[i]);
+            }
+        } else if (typeid(*cur) == typeid(ReturnWithVal)) {
+            addMove(nodeOf(*cur->use.begin()), 0, weight[i]);
+        } else if (typeid(*cur) == typeid(Arg)) {
+            if (++argCount <= static_cast<int>(ARG_REGISTERS.size())) {
+                written.push_back(argCount - 1);
+                addMove(nodeOf(*cur->use.begin()), argCount - 1, weight[i]);
+            }
+        } else if (typeid(*cur) == typeid(Call) || typeid(*cur) == typeid(CallWithRet)) {
+            CallNode *call = static_cast<CallNode *>(cur);
+            const std::unordered_set<int> &clobbers = table->getClobbers(call->getName());
+            used.insert(clobbers.begin(), clobbers.end());
+            for (auto &o : cur->out) {
+                if (o != call->getLhs().ident && nodeOf(o) >= 0) {
+                    crossed[nodeOf(o)].emplace_back(&clobbers, weight[i]);
+                }
+            }
+            if (typeid(*cur) == typeid(CallWithRet)) {
+                addMove(nodeOf(call->getLhs().ident), 0, weight[i]);
+            }
+            written.clear();
+            argCount = 0;
+            continue;
+        }
+        for (int reg : written) {
+            for (auto *set : {&cur->out, &cur->def}) {
+                for (auto &ident : *set) {
+                    addEdge(reg, nodeOf(ident));
+                }
+            }
+        }
+    }
 
-        if (freeRegisters.empty()) {
-            // spill
-            auto spill = active.begin();
-            if (spill->first.end > i.end) {
-                int reg = spill->second;
-                table->insertStack(spill->first.ident, SIZE_OF_INT);
-                active.erase(spill);
-                active[i] = reg;
+    // coalesce the ends of moves, the most frequent first, until no more can be merged safely
+    std::vector<int> alias(n);
+    for (int i = 0; i < n; ++i) {
+        alias[i] = i;
+    }
+    auto find = [&](int v) {
+        while (alias[v] != v) {
+            v = alias[v] = alias[alias[v]];
+        }
+        return v;
+    };
+    auto significant = [&](int t) { return t < K || static_cast<int>(adj[t].size()) >= K; };
+    std::stable_sort(moves.begin(), moves.end(), [](const Move &a, const Move &b) { return a.weight > b.weight; });
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (auto &move : moves) {
+            int u = find(move.u), v = find(move.v);
+            if (v < K) {
+                std::swap(u, v);
+            }
+            if (u == v || v < K || adj[u].count(v)) {
+                continue;
+            }
+            bool safe;
+            if (u < K) {
+                // George: each neighbour already interferes with the register or has few neighbours,
+                // and only values not living across calls go into an argument register
+                safe = crossed[v].empty() && std::all_of(adj[v].begin(), adj[v].end(), [&](int t) {
+                           return t < K || adj[t].count(u) || !significant(t);
+                       });
             } else {
-                table->insertStack(i.ident, SIZE_OF_INT);
+                // Briggs: the merged node has fewer than K neighbours with K or more neighbours
+                std::unordered_set<int> neighbours(adj[u]);
+                neighbours.insert(adj[v].begin(), adj[v].end());
+                safe = std::count_if(neighbours.begin(), neighbours.end(), significant) < K;
             }
-        } else {
-            int reg = *freeRegisters.begin();
-            freeRegisters.erase(reg);
-            active[i] = reg;
+            if (!safe) {
+                continue;
+            }
+            alias[v] = u;
+            for (int t : adj[v]) {
+                adj[t].erase(v);
+                addEdge(u, t);
+            }
+            adj[v].clear();
+            if (u >= K) {
+                cost[u] += cost[v];
+                crossed[u].insert(crossed[u].end(), crossed[v].begin(), crossed[v].end());
+            }
+            changed = true;
         }
     }
-    for (auto i : active) {
-        table->identReg[i.first.ident] = i.second;
+
+    // simplify, pushing a cheap significant node optimistically when every node left is significant
+    std::vector<int> degree(n, 0), stack, low;
+    std::vector<bool> removed(n, false);
+    int remaining = 0;
+    for (int v = K; v < n; ++v) {
+        if (find(v) == v) {
+            degree[v] = adj[v].size();
+            ++remaining;
+            if (degree[v] < K) {
+                low.push_back(v);
+            }
+        }
+    }
+    while (static_cast<int>(stack.size()) < remaining) {
+        int v = -1;
+        while (!low.empty() && v == -1) {
+            v = removed[low.back()] ? -1 : low.back();
+            low.pop_back();
+        }
+        if (v == -1) {
+            for (int t = K; t < n; ++t) {
+                if (find(t) == t && !removed[t] &&
+                    (v == -1 || static_cast<long double>(cost[t]) * degree[v] < static_cast<long double>(cost[v]) * degree[t])) {
+                    v = t;
+                }
+            }
+        }
+        removed[v] = true;
+        stack.push_back(v);
+        for (int t : adj[v]) {
+            if (t >= K && !removed[t] && --degree[t] == K - 1) {
+                low.push_back(t);
+            }
+        }
+    }
+
+    // select
+    std::vector<int> color(n, -1);
+    for (int i = 0; i < K; ++i) {
+        color[i] = colors[i];
+    }
+    std::vector<std::vector<std::pair<int, long long>>> partners(n);
+    for (auto &move : moves) {
+        int u = find(move.u), v = find(move.v);
+        if (u != v) {
+            partners[u].emplace_back(v, move.weight);
+            partners[v].emplace_back(u, move.weight);
+        }
+    }
+    while (!stack.empty()) {
+        int v = stack.back();
+        stack.pop_back();
+        std::unordered_set<int> taken;
+        for (int t : adj[v]) {
+            if (color[t] >= 0) {
+                taken.insert(color[t]);
+            }
+        }
+        // a call clobbering the register costs a store and a load, a move to a partner of another color one move
+        long long bestScore = 0;
+        for (int reg : colors) {
+            if (taken.count(reg)) {
+                continue;
+            }
+            long long score = 0;
+            for (auto &call : crossed[v]) {
+                score += call.first->count(reg) ? 2 * call.second : 0;
+            }
+            for (auto &partner : partners[v]) {
+                score -= color[partner.first] == reg ? partner.second : 0;
+            }
+            if (color[v] == -1 || score < bestScore || (score == bestScore && used.count(reg) > used.count(color[v]))) {
+                color[v] = reg;
+                bestScore = score;
+            }
+        }
+        if (color[v] >= 0) {
+            used.insert(color[v]);
+        }
+    }
+
+    // a register holds its variable from the start, a use placed before the definition reads it as it is
+    for (int v = K; v < n; ++v) {
+        if (color[find(v)] >= 0) {
+            table->identReg[idents[v]] = color[find(v)];
+            table->regState[color[find(v)]] |= 1;
+        } else {
+            table->insertStack(idents[v], SIZE_OF_INT);
+        }
     }
 }
 
@@ -414,64 +1361,234 @@ void FuncDefNode::generate(GenerateTable *table, AssemblyNode *&tail) {
     std::vector<IRNode *> nodes;
     livenessAnalysisFunc(table, nodes, this);
 
-    // prologue
+    // edges into each label generated before it, the previous node falls through unless it jumps or returns
+    table->labelPreds.clear();
+    table->loopHeaders.clear();
+    table->labelTemps.clear();
+    for (auto cur : nodes) {
+        std::string label;
+        if (typeid(*cur) == typeid(Label)) {
+            IRNode *prev = cur->index > 0 ? nodes[cur->index - 1] : nullptr;
+            bool fallthrough = prev == nullptr || (typeid(*prev) != typeid(Goto) && typeid(*prev) != typeid(Return) &&
+                                                   typeid(*prev) != typeid(ReturnWithVal));
+            table->labelPreds[static_cast<Label *>(cur)->getName()] += fallthrough ? 1 : 0;
+            continue;
+        } else if (typeid(*cur) == typeid(Goto)) {
+            label = static_cast<Goto *>(cur)->getLabel();
+        } else if (typeid(*cur) == typeid(CondGoto)) {
+            label = static_cast<CondGoto *>(cur)->getLabel();
+        } else {
+            continue;
+        }
+        auto it = table->labelMap.find(label);
+        if (it != table->labelMap.end() && it->second->index <= cur->index) {
+            table->loopHeaders.insert(label);
+        } else {
+            ++table->labelPreds[label];
+        }
+    }
+
+    // idents whose every definition is `x = #0` live in x0
+    table->zeroIdents.clear();
+    std::unordered_set<std::string> nonZero;
+    for (auto cur : nodes) {
+        if (typeid(*cur) == typeid(VarDec)) {
+            nonZero.insert(static_cast<VarDec *>(cur)->getIdent().ident);
+        }
+        for (auto &ident : cur->def) {
+            if (typeid(*cur) == typeid(LoadImm) && static_cast<LoadImm *>(cur)->getValue().value == 0) {
+                table->zeroIdents.insert(ident);
+            } else {
+                nonZero.insert(ident);
+            }
+        }
+    }
+    for (auto &ident : nonZero) {
+        table->zeroIdents.erase(ident);
+    }
+
+    // prologue, the largest array first as the first slot lies farthest from sp, the smaller arrays and the word
+    // slots below it start within a 12-bit offset
+    std::vector<VarDec *> arrays;
+    for (IRNode *cur : nodes) {
+        if (typeid(*cur) == typeid(FuncDefNode)) {
+            break;
+        }
+        if (typeid(*cur) == typeid(VarDec)) {
+            arrays.push_back(static_cast<VarDec *>(cur));
+        }
+    }
+    std::stable_sort(arrays.begin(), arrays.end(),
+                     [](VarDec *a, VarDec *b) { return a->getSize().value > b->getSize().value; });
+    for (auto array : arrays) {
+        array->prologue(table);
+    }
     for (IRNode *cur : nodes) {
         if (typeid(*cur) == typeid(FuncDefNode)) {
             break;
         }
-        cur->prologue(table);
+        if (typeid(*cur) != typeid(VarDec)) {
+            cur->prologue(table);
+        }
+    }
+    std::vector<CallNode *> calls;
+    for (auto cur : nodes) {
+        if (typeid(*cur) == typeid(Call) || typeid(*cur) == typeid(CallWithRet)) {
+            calls.push_back(static_cast<CallNode *>(cur));
+        }
+    }
+    // leaf functions keep ra in place
+    if (!calls.empty()) {
+        table->insertStack("_ra", SIZE_OF_INT);
     }
-    table->insertStack("_ra", SIZE_OF_INT);
 
-    // linear scan
-    linearScan(table, nodes, this);
+    // register allocation
+    if (graphColoring) {
+        colorRegisters(table, nodes);
+    } else {
+        linearScan(table, nodes, this);
+    }
 
-    // set size for stack of saved registers at the beginning of the function
-    std::unordered_set<int> savedRegs;
-    for (auto i : table->identReg) {
-        if (std::find(SAVED_REGISTERS.begin(), SAVED_REGISTERS.end(), i.second) != SAVED_REGISTERS.end() &&
-            savedRegs.find(i.second) == savedRegs.end()) {
-            savedRegs.emplace(i.second);
-            table->insertStack("_" + REGISTER_NAMES[i.second], SIZE_OF_INT);
+    // the word slots so far lie between the arrays and sp, the most used ones nearest sp so that they stay within
+    // a 12-bit offset when the slots of a large frame do not
+    std::vector<long long> weight = nodeWeights(table, nodes);
+    std::unordered_map<std::string, long long> uses;
+    for (auto cur : nodes) {
+        for (auto &ident : cur->use) {
+            uses[ident] += weight[cur->index];
+        }
+        for (auto &ident : cur->def) {
+            uses[ident] += weight[cur->index];
+        }
+    }
+    std::vector<std::pair<int, std::string>> slots;
+    for (auto &slot : table->identStackOffset) {
+        if (slot.second > 0 && table->arraySet.find(slot.first) == table->arraySet.end()) {
+            slots.emplace_back(slot.second, slot.first);
         }
     }
+    std::sort(slots.begin(), slots.end());
+    std::vector<std::string> order;
+    for (auto &slot : slots) {
+        order.push_back(slot.second);
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&](const std::string &a, const std::string &b) { return uses[a] < uses[b]; });
+    for (auto i = 0ull; i < slots.size(); ++i) {
+        table->identStackOffset[order[i]] = slots[i].first;
+    }
 
-    // set call node's save context size
-    for (auto cur : nodes) {
-        if (typeid(*cur) == typeid(Call) || typeid(*cur) == typeid(CallWithRet)) {
-            static_cast<CallNode *>(cur)->saveContextSize(table);
+    // set size for stack of saved registers at the beginning of the function,
+    // only functions in a recursive cycle save them, callers of the others save what is live across the call
+    table->savedRegs.clear();
+    if (table->preserveSaved) {
+        for (auto i : table->identReg) {
+            table->savedRegs.insert(i.second);
+        }
+        for (auto call : calls) {
+            const std::unordered_set<int> &clobbers = table->getClobbers(call->getName());
+            table->savedRegs.insert(clobbers.begin(), clobbers.end());
+        }
+        for (auto it = table->savedRegs.begin(); it != table->savedRegs.end();) {
+            if (std::find(SAVED_REGISTERS.begin(), SAVED_REGISTERS.end(), *it) == SAVED_REGISTERS.end()) {
+                it = table->savedRegs.erase(it);
+            } else {
+                table->insertStack("_" + REGISTER_NAMES[*it], SIZE_OF_INT);
+                ++it;
+            }
         }
     }
 
+    // set call node's save context size
+    for (auto call : calls) {
+        call->saveContextSize(table);
+    }
+
     // generate assembly
     table->stackOffset += table->curStackPreserve;
     linkToTail(tail, new LabelAssembly(name.ident));
-    if (table->stackOffset > 2048) {
-        throw std::runtime_error("TODO: prologue size too large");
-    } else {
-        linkToTail(tail, new BinaryImmAssembly(Register(2), Register(2), ImmAssembly(-table->stackOffset), "+"));
+    if (table->stackOffset > 0) {
+        adjustStack(tail, -table->stackOffset);
     }
     // sw
-    linkToTail(tail, new Sw(Register(1), Register(2), table->getStackOffset("_ra")));
-    for (auto i : savedRegs) {
-        linkToTail(tail, new Sw(Register(i), Register(2), table->getStackOffset("_" + REGISTER_NAMES[i])));
+    if (!calls.empty()) {
+        storeStack(tail, Register(1), table->getStackOffset("_ra"));
+    }
+    for (auto i : table->savedRegs) {
+        storeStack(tail, Register(i), table->getStackOffset("_" + REGISTER_NAMES[i]));
+    }
+    // parameters arrive in a0-a7, graph coloring may place them elsewhere; one dead at the entry is not moved, its
+    // register may belong to another parameter
+    std::vector<std::pair<int, int>> paramMoves;  // destination, source
+    int paramCount = 0;
+    for (auto cur : nodes) {
+        if (typeid(*cur) != typeid(Param) || ++paramCount > static_cast<int>(ARG_REGISTERS.size()) ||
+            cur->out.find(*cur->def.begin()) == cur->out.end()) {
+            continue;
+        }
+        std::string ident = *cur->def.begin();
+        int source = ARG_REGISTERS[paramCount - 1];
+        if (table->identReg.find(ident) != table->identReg.end()) {
+            if (table->identReg[ident] != source) {
+                paramMoves.emplace_back(table->identReg[ident], source);
+            }
+        } else if (table->identStackOffset.find(ident) != table->identStackOffset.end()) {
+            storeStack(tail, Register(source), table->getStackOffset(ident));
+        }
+    }
+    // the moves happen at once, a cycle is broken through a temp register
+    while (!paramMoves.empty()) {
+        auto ready = std::find_if(paramMoves.begin(), paramMoves.end(), [&](const std::pair<int, int> &move) {
+            return std::none_of(paramMoves.begin(), paramMoves.end(),
+                                [&](const std::pair<int, int> &other) { return other.second == move.first; });
+        });
+        if (ready == paramMoves.end()) {
+            ready = paramMoves.begin();
+            linkToTail(tail, new Mv(Register(TEMP_REGISTERS[0]), Register(ready->first)));
+            for (auto &move : paramMoves) {
+                if (move.second == ready->first) {
+                    move.second = TEMP_REGISTERS[0];
+                }
+            }
+        }
+        linkToTail(tail, new Mv(Register(ready->first), Register(ready->second)));
+        paramMoves.erase(ready);
+    }
+    // parameters passed on the stack and kept in registers are loaded once
+    paramCount = 0;
+    for (auto cur : nodes) {
+        if (typeid(*cur) != typeid(Param) || ++paramCount <= static_cast<int>(ARG_REGISTERS.size()) ||
+            cur->out.find(*cur->def.begin()) == cur->out.end()) {
+            continue;
+        }
+        std::string ident = *cur->def.begin();
+        if (table->identReg.find(ident) != table->identReg.end()) {
+            int reg = table->identReg[ident];
+            loadStack(tail, Register(reg), table->getStackOffset(ident));
+            table->regState[reg] |= 1;
+        }
+    }
+    // arrays in registers hold their address for the whole function, the first use may be in any branch
+    for (auto &ident : table->arraySet) {
+        if (table->identReg.find(ident) != table->identReg.end()) {
+            int reg = table->identReg[ident];
+            addressStack(tail, Register(reg), table->getStackOffset(ident));
+            table->regState[reg] |= 1;
+        }
     }
 }
 
 int CallNode::saveContextSize(GenerateTable *table) {
     int size = 0;
-    for (auto i : table->live) {
-        if (i.ident == lhs.ident) {
-            continue;
-        }
-        if (i.start < index && i.end > index) {
-            // only save registers that need caller to save
-            if (table->identReg.find(i.ident) != table->identReg.end() &&
-                std::find(SAVED_REGISTERS.begin(), SAVED_REGISTERS.end(), table->identReg[i.ident]) ==
-                    SAVED_REGISTERS.end()) {
-                savedIdent.emplace_back(i.ident);
-                size += table->insertStack(i.ident, SIZE_OF_INT);
-            }
+    // the idents live after the call, in a fixed order
+    std::vector<std::string> live(out.begin(), out.end());
+    std::sort(live.begin(), live.end());
+    for (auto &ident : live) {
+        // only save registers the callee may modify
+        if (ident != lhs.ident && table->identReg.find(ident) != table->identReg.end() &&
+            table->getClobbers(name).count(table->identReg[ident])) {
+            savedIdent.emplace_back(ident);
+            size += table->insertStack(ident, SIZE_OF_INT);
         }
     }
     return size;
@@ -479,11 +1596,12 @@ int CallNode::saveContextSize(GenerateTable *table) {
 
 void CallNode::saveContext(GenerateTable *table, AssemblyNode *&tail) {
     for (auto i : savedIdent) {
-        if (i == lhs.ident) {
+        // the stack slot of an array is its storage, its address is recomputed after the call
+        if (i == lhs.ident || table->arraySet.find(i) != table->arraySet.end()) {
             continue;
         }
         Register reg = table->allocateReg(i, tail, true);
-        linkToTail(tail, new Sw(reg, Register(2), table->getStackOffset(i)));
+        storeStack(tail, reg, table->getStackOffset(i));
         table->free(i, reg, tail, false);
     }
 }
@@ -493,8 +1611,12 @@ void CallNode::loadContext(GenerateTable *table, AssemblyNode *&tail) {
         if (i == lhs.ident) {
             continue;
         }
+        if (table->arraySet.find(i) != table->arraySet.end()) {
+            addressStack(tail, Register(table->identReg[i]), table->getStackOffset(i));
+            continue;
+        }
         Register reg = table->allocateReg(i, tail, false);
-        linkToTail(tail, new Lw(reg, Register(2), table->getStackOffset(i)));
+        loadStack(tail, reg, table->getStackOffset(i));
         table->free(i, reg, tail, true);
     }
 }
@@ -508,12 +1630,19 @@ void CallWithRet::generate(GenerateTable *table, AssemblyNode *&tail) {
     saveTemp(table, tail);
     linkToTail(tail, new CallAssembly(name));
     Register lhsReg = table->allocateReg(lhs.ident, tail, false);
-    linkToTail(tail, new Mv(lhsReg, Register(10)));
+    if (lhsReg.index != 10) {
+        linkToTail(tail, new Mv(lhsReg, Register(10)));
+    }
     table->free(lhs.ident, lhsReg, tail, true);
     table->curArgCount = 0;
     loadContext(table, tail);
 }
 
+void CallWithRet::renameDef(std::string from, std::string to) {
+    renameIdent(lhs, from, to);
+    def = {lhs.ident};
+}
+
 void Call::print() { printToFile(immediateFile, "CALL %s\n", name.c_str()); }
 
 void Call::generate(GenerateTable *table, AssemblyNode *&tail) {
@@ -564,37 +1693,49 @@ void Arg::generate(GenerateTable *table, AssemblyNode *&tail) {
     }
     if (table->curArgCount <= 8) {
         Register argReg = table->allocateReg(ident.ident, tail, true);
-        linkToTail(tail, new Mv(Register(table->curArgCount + 9), argReg));
+        if (argReg.index != table->curArgCount + 9) {
+            linkToTail(tail, new Mv(Register(table->curArgCount + 9), argReg));
+        }
     } else {
         Register argReg = table->allocateReg(ident.ident, tail, true);
-        linkToTail(tail, new Sw(argReg, Register(2), (table->curArgCount - 9) * SIZE_OF_INT));
+        storeStack(tail, argReg, (table->curArgCount - 9) * SIZE_OF_INT);
     }
 }
 
+void Arg::renameUse(std::string from, std::string to) {
+    renameIdent(ident, from, to);
+    use = {ident.ident};
+}
+
 static void epilogue(GenerateTable *table, AssemblyNode *&tail) {
-    std::unordered_set<int> savedRegs;
-    for (auto i : table->identReg) {
-        if (std::find(SAVED_REGISTERS.begin(), SAVED_REGISTERS.end(), i.second) != SAVED_REGISTERS.end() &&
-            savedRegs.find(i.second) == savedRegs.end()) {
-            savedRegs.emplace(i.second);
-            linkToTail(tail,
-                       new Lw(Register(i.second), Register(2), table->getStackOffset("_" + REGISTER_NAMES[i.second])));
-        }
+    for (auto i : table->savedRegs) {
+        loadStack(tail, Register(i), table->getStackOffset("_" + REGISTER_NAMES[i]));
+    }
+    if (table->identStackOffset.find("_ra") != table->identStackOffset.end()) {
+        loadStack(tail, Register(1), table->getStackOffset("_ra"));  // ra
+    }
+    if (table->stackOffset > 0) {
+        adjustStack(tail, table->stackOffset);
     }
-    linkToTail(tail, new Lw(Register(1), Register(2), table->getStackOffset("_ra")));  // ra
-    linkToTail(tail, new BinaryImmAssembly(Register(2), Register(2), ImmAssembly(table->stackOffset), "+"));
 }
 
 void ReturnWithVal::print() { printToFile(immediateFile, "RETURN %s\n", ident.ident.c_str()); }
 
 void ReturnWithVal::generate(GenerateTable *table, AssemblyNode *&tail) {
     Register retReg = table->allocateReg(ident.ident, tail, true);
-    linkToTail(tail, new Mv(Register(10), retReg));
+    if (retReg.index != 10) {
+        linkToTail(tail, new Mv(Register(10), retReg));
+    }
     saveTemp(table, tail);
     epilogue(table, tail);
     linkToTail(tail, new Ret());
 }
 
+void ReturnWithVal::renameUse(std::string from, std::string to) {
+    renameIdent(ident, from, to);
+    use = {ident.ident};
+}
+
 void Return::print() { printToFile(immediateFile, "RETURN\n"); }
 
 void Return::generate(GenerateTable *table, AssemblyNode *&tail) {
@@ -621,8 +1762,153 @@ void LoadGlobal::generate(GenerateTable *table, AssemblyNode *&tail) {
     table->free(lhs.ident, lhsReg, tail, true);
 }
 
-void Word::print() { printToFile(immediateFile, ".WORD #%d\n", imm.value); }
+void LoadGlobal::renameDef(std::string from, std::string to) {
+    renameIdent(lhs, from, to);
+    def = {lhs.ident};
+}
+
+void Word::print() {
+    for (auto value : values) {
+        printToFile(immediateFile, ".WORD #%d\n", value);
+    }
+}
 
 void Word::generate(GenerateTable *table, AssemblyNode *&tail) {
-    linkToTail(tail, new WordAssembly(ImmAssembly(imm.value)));
-}
\ No newline at end of file
+    const int WORDS_PER_LINE = 8;
+    for (auto i = 0ull; i < values.size(); i += WORDS_PER_LINE) {
+        std::vector<ImmAssembly> line;
+        for (auto j = i; j < values.size() && j < i + WORDS_PER_LINE; ++j) {
+            line.emplace_back(values[j]);
+        }
+        linkToTail(tail, new WordAssembly(line));
+    }
+}
+
+void Zero::print() { printToFile(immediateFile, ".ZERO #%d\n", size.value); }
+
+void Zero::generate(GenerateTable *table, AssemblyNode *&tail) {
+    linkToTail(tail, new SpaceAssembly(ImmAssembly(size.value)));
+}
+// Tarjan's algorithm, strongly connected components come out callees first
+static void sortCallGraph(int v, const std::vector<std::vector<int>> &callees, int &counter, std::vector<int> &index,
+                          std::vector<int> &low, std::vector<int> &stack, std::vector<bool> &onStack,
+                          std::vector<std::vector<int>> &components) {
+    index[v] = low[v] = counter++;
+    stack.push_back(v);
+    onStack[v] = true;
+    for (int w : callees[v]) {
+        if (index[w] == -1) {
+            sortCallGraph(w, callees, counter, index, low, stack, onStack, components);
+            low[v] = std::min(low[v], low[w]);
+        } else if (onStack[w]) {
+            low[v] = std::min(low[v], index[w]);
+        }
+    }
+    if (low[v] == index[v]) {
+        components.emplace_back();
+        int w;
+        do {
+            w = stack.back();
+            stack.pop_back();
+            onStack[w] = false;
+            components.back().push_back(w);
+        } while (w != v);
+    }
+}
+
+void generateFunctions(IRNode *root, GenerateTable *table, AssemblyNode *&tail,
+                       const std::unordered_map<std::string, CachedFunction> &cached) {
+    // call graph
+    std::vector<FuncDefNode *> funcs;
+    std::unordered_map<std::string, int> funcIndex;
+    std::vector<std::vector<int>> callees;
+    for (IRNode *cur = root; cur != nullptr; cur = cur->next) {
+        if (typeid(*cur) == typeid(FuncDefNode)) {
+            funcIndex[static_cast<FuncDefNode *>(cur)->getName()] = funcs.size();
+            funcs.push_back(static_cast<FuncDefNode *>(cur));
+        } else if (funcs.empty()) {
+            cur->generate(table, tail);
+        }
+    }
+    callees.resize(funcs.size());
+    for (auto i = 0ull; i < funcs.size(); ++i) {
+        for (IRNode *cur = funcs[i]->next; cur != nullptr && typeid(*cur) != typeid(FuncDefNode); cur = cur->next) {
+            if (typeid(*cur) == typeid(Call) || typeid(*cur) == typeid(CallWithRet)) {
+                auto it = funcIndex.find(static_cast<CallNode *>(cur)->getName());
+                if (it != funcIndex.end()) {
+                    callees[i].push_back(it->second);
+                }
+            }
+        }
+    }
+    std::vector<int> index(funcs.size(), -1), low(funcs.size()), stack;
+    std::vector<bool> onStack(funcs.size(), false);
+    std::vector<std::vector<int>> components;
+    int counter = 0;
+    for (auto i = 0ull; i < funcs.size(); ++i) {
+        if (index[i] == -1) {
+            sortCallGraph(i, callees, counter, index, low, stack, onStack, components);
+        }
+    }
+
+    // generate callees first, each function into its own list
+    std::vector<std::pair<AssemblyNode *, AssemblyNode *>> code(funcs.size());
+    for (auto &component : components) {
+        bool recursive = component.size() > 1 || std::find(callees[component[0]].begin(),
+                                                            callees[component[0]].end(),
+                                                            component[0]) != callees[component[0]].end();
+        for (int i : component) {
+            AssemblyNode *head = new AssemblyNode(), *funcTail = head;
+            auto reused = cached.find(funcs[i]->getName());
+            if (reused != cached.end()) {
+                linkToTail(funcTail, new TextAssembly(reused->second.assembly));
+                code[i] = {head, funcTail};
+                continue;
+            }
+            table->preserveSaved = recursive;
+            for (IRNode *cur = funcs[i]; cur != nullptr; cur = cur->next) {
+                if (cur != funcs[i] && typeid(*cur) == typeid(FuncDefNode)) {
+                    break;
+                }
+                cur->generate(table, funcTail);
+            }
+            if (postSchedule) {
+                scheduleBlocks(head, funcTail);
+            }
+            code[i] = {head, funcTail};
+        }
+        // record what the functions modify once the whole component is generated
+        for (int i : component) {
+            auto reused = cached.find(funcs[i]->getName());
+            if (reused != cached.end()) {
+                table->clobbers[funcs[i]->getName()] = reused->second.clobbers;
+                continue;
+            }
+            std::unordered_set<int> clobbers = table->getClobbers("");
+            if (!recursive) {
+                for (auto &reg : table->identReg) {
+                    clobbers.insert(reg.second);
+                }
+                for (IRNode *cur = funcs[i]->next; cur != nullptr && typeid(*cur) != typeid(FuncDefNode);
+                     cur = cur->next) {
+                    if (typeid(*cur) == typeid(Call) || typeid(*cur) == typeid(CallWithRet)) {
+                        const std::unordered_set<int> &regs =
+                            table->getClobbers(static_cast<CallNode *>(cur)->getName());
+                        clobbers.insert(regs.begin(), regs.end());
+                    }
+                }
+            }
+            table->clobbers[funcs[i]->getName()] = clobbers;
+        }
+    }
+
+    // emit in source order
+    for (auto &func : code) {
+        if (func.first->next != nullptr) {
+            tail->next = func.first->next;
+            tail = func.second;
+        }
+        func.first->next = nullptr;
+        delete func.first;
+    }
+}
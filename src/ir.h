@@ -3,6 +3,7 @@
 
 #include "assembly.h"
 #include "common.h"
+#include <cstdio>
 #include <string>
 #include <unordered_map>
 #include <map>
@@ -18,13 +19,11 @@ class VarInterval {
     VarInterval() = default;
     VarInterval(std::string ident, int start, int end) : ident(ident), start(start), end(end) {}
     bool operator<(const VarInterval &other) const { return start < other.start; }
-    bool operator>(const VarInterval &other) const {
-        return std::tie(end, start, ident) > std::tie(other.end, other.start, other.ident);
-    }
 
     std::string ident;
     int start;
     int end;
+    std::vector<std::pair<int, int>> ranges;  // [start, end) pieces where the ident is live, in order
 };
 
 class GenerateTable {
@@ -32,24 +31,34 @@ class GenerateTable {
     int insertStack(std::string ident, int size);
     int getStackOffset(std::string ident);
     Register allocateReg(std::string ident, AssemblyNode *&tail, bool needLoad);
+    Register allocateScratch(AssemblyNode *&tail);  // a temp register for intermediate values, release by clear()
     void free(std::string ident, Register reg, AssemblyNode *&tail, bool needStore);
     void clear(Register reg, AssemblyNode *&tail);
+    const std::unordered_set<int> &getClobbers(std::string func);  // registers a call to func may modify
 
     int curArgCount = 0;
     int curParamCount = 0;
     int stackOffset = 0;
     int curStackPreserve = 0;                               // preserve for call with more than 8 arguments
+    bool preserveSaved = false;                             // whether the function keeps s registers intact
     unsigned int lastVictim = 0;                            // last victim register index in TEMP_REGISTERS
     std::unordered_map<std::string, int> identStackOffset;  // ident -> stack offset
     std::unordered_map<std::string, int> identReg;          // ident -> register index
     std::unordered_set<std::string> arraySet;               // arrays
+    std::unordered_set<std::string> zeroIdents;             // idents only assigned 0, kept in x0
     std::vector<short> regState = std::vector<short>(
         NUM_OF_REG, 0);  // register index -> is dirty | is used (is dirty bit only used in temp registers)
     std::vector<std::string> tempReg =
         std::vector<std::string>(TEMP_REGISTERS.size(), "");    // ident stored in temp registers
     std::unordered_map<std::string, IRNode *> labelMap;         // label -> IRNode
+    std::unordered_map<std::string, int> labelPreds;            // label -> number of edges generated before it
+    std::unordered_set<std::string> loopHeaders;                // labels a later branch jumps back to
+    std::unordered_map<std::string, std::vector<std::vector<std::pair<std::string, short>>>>
+        labelTemps;  // label -> temp registers (ident, is dirty) on each edge generated into it
     std::unordered_map<std::string, VarInterval> varIntervals;  // ident -> VarInterval
-    std::vector<VarInterval> live;                              // live intervals in the current function
+    std::unordered_set<int> savedRegs;                          // s registers saved in the prologue
+    std::unordered_map<std::string, std::unordered_set<int>> clobbers = {
+        {"read", {10}}, {"write", {10, 11}}};  // function -> registers it may modify, known once generated
 };
 
 class IRNode {
@@ -64,9 +73,13 @@ class IRNode {
     virtual int prologue(GenerateTable *table) { return 0; }
     virtual bool livenessAnalysis(GenerateTable *table) { return _livenessAnalysis(next); }
     virtual void generate(GenerateTable *table, AssemblyNode *&tail) { throw "IRNode::generate() not implemented!"; }
+    virtual void renameUse(std::string from, std::string to) {}  // replace the used ident `from` with `to`
+    virtual void renameDef(std::string from, std::string to) {}  // replace the defined ident `from` with `to`
+    virtual IRNode *clone() { return nullptr; }                 // copy without next, nullptr if not copyable
 
     IRNode *next = nullptr;
     int index;
+    long long count = -1;  // times the node ran in the profile run, -1 if unknown
 
     std::unordered_set<std::string> use, def;
     std::unordered_set<std::string> in, out;
@@ -75,6 +88,13 @@ class IRNode {
     virtual bool _livenessAnalysis(IRNode *next, IRNode *second = nullptr);
 };
 
+template <typename T>
+IRNode *cloneNode(T *node) {
+    T *copy = new T(*node);
+    copy->next = nullptr;
+    return copy;
+}
+
 class Immediate {
    public:
     Immediate(int value) : value(value) {}
@@ -92,6 +112,11 @@ class LoadImm : public IRNode {
     LoadImm(Identifier ident, Immediate value) : ident(ident), value(value) { def.emplace(ident.ident); }
     void print() override;
     void generate(GenerateTable *table, AssemblyNode *&tail) override;
+    IRNode *clone() override { return cloneNode(this); }
+    void renameDef(std::string from, std::string to) override;
+
+    Identifier getIdent() { return ident; }
+    Immediate getValue() { return value; }
 
    private:
     Identifier ident;
@@ -106,6 +131,12 @@ class Assign : public IRNode {
     }
     void print() override;
     void generate(GenerateTable *table, AssemblyNode *&tail) override;
+    IRNode *clone() override { return cloneNode(this); }
+    void renameUse(std::string from, std::string to) override;
+    void renameDef(std::string from, std::string to) override;
+
+    Identifier getLhs() { return lhs; }
+    Identifier getRhs() { return rhs; }
 
    private:
     Identifier lhs, rhs;
@@ -120,6 +151,14 @@ class Binop : public IRNode {
     }
     void print() override;
     void generate(GenerateTable *table, AssemblyNode *&tail) override;
+    IRNode *clone() override { return cloneNode(this); }
+    void renameUse(std::string from, std::string to) override;
+    void renameDef(std::string from, std::string to) override;
+
+    Identifier getLhs() { return lhs; }
+    Identifier getRhs1() { return rhs1; }
+    Identifier getRhs2() { return rhs2; }
+    std::string getOp() { return op; }
 
    private:
     Identifier lhs, rhs1, rhs2;
@@ -134,6 +173,14 @@ class BinopImm : public IRNode {
     }
     void print() override;
     void generate(GenerateTable *table, AssemblyNode *&tail) override;
+    IRNode *clone() override { return cloneNode(this); }
+    void renameUse(std::string from, std::string to) override;
+    void renameDef(std::string from, std::string to) override;
+
+    Identifier getLhs() { return lhs; }
+    Identifier getRhs() { return rhs; }
+    Immediate getImm() { return imm; }
+    std::string getOp() { return op; }
 
    private:
     Identifier lhs, rhs;
@@ -149,6 +196,13 @@ class Unop : public IRNode {
     }
     void print() override;
     void generate(GenerateTable *table, AssemblyNode *&tail) override;
+    IRNode *clone() override { return cloneNode(this); }
+    void renameUse(std::string from, std::string to) override;
+    void renameDef(std::string from, std::string to) override;
+
+    Identifier getLhs() { return lhs; }
+    Identifier getRhs() { return rhs; }
+    std::string getOp() { return op; }
 
    private:
     Identifier lhs, rhs;
@@ -163,6 +217,12 @@ class Load : public IRNode {
     }
     void print() override;
     void generate(GenerateTable *table, AssemblyNode *&tail) override;
+    IRNode *clone() override { return cloneNode(this); }
+    void renameUse(std::string from, std::string to) override;
+    void renameDef(std::string from, std::string to) override;
+
+    Identifier getLhs() { return lhs; }
+    Identifier getRhs() { return rhs; }
 
    private:
     Identifier lhs, rhs;
@@ -176,6 +236,11 @@ class Store : public IRNode {
     }
     void print() override;
     void generate(GenerateTable *table, AssemblyNode *&tail) override;
+    IRNode *clone() override { return cloneNode(this); }
+    void renameUse(std::string from, std::string to) override;
+
+    Identifier getLhs() { return lhs; }
+    Identifier getRhs() { return rhs; }
 
    private:
     Identifier lhs, rhs;
@@ -199,6 +264,10 @@ class Goto : public IRNode {
     void print() override;
     bool livenessAnalysis(GenerateTable *table) override { return _livenessAnalysis(table->labelMap[label]); }
     void generate(GenerateTable *table, AssemblyNode *&tail) override;
+    IRNode *clone() override { return cloneNode(this); }
+
+    std::string getLabel() { return label; }
+    void setLabel(std::string label) { this->label = label; }
 
    private:
     std::string label;
@@ -214,6 +283,15 @@ class CondGoto : public IRNode {
     void print() override;
     bool livenessAnalysis(GenerateTable *table) override { return _livenessAnalysis(next, table->labelMap[label]); }
     void generate(GenerateTable *table, AssemblyNode *&tail) override;
+    IRNode *clone() override { return cloneNode(this); }
+    void renameUse(std::string from, std::string to) override;
+
+    Identifier getLhs() { return lhs; }
+    Identifier getRhs() { return rhs; }
+    std::string getOp() { return op; }
+    std::string getLabel() { return label; }
+    void setLabel(std::string label) { this->label = label; }
+    void invert();  // negate the condition
 
    private:
     Identifier lhs, rhs;
@@ -223,6 +301,7 @@ class CondGoto : public IRNode {
 class FuncDefNode : public IRNode {
    public:
     FuncDefNode(Identifier name) : name(name) {}
+    std::string getName() { return name.ident; }
     void print() override;
     void generate(GenerateTable *table, AssemblyNode *&tail) override;
 
@@ -232,43 +311,43 @@ class FuncDefNode : public IRNode {
 
 class CallNode : public IRNode {
    public:
-    CallNode() : lhs("") {}
-    CallNode(Identifier lhs) : lhs(lhs) { def.emplace(lhs.ident); }
+    CallNode(std::string name) : lhs(""), name(name) {}
+    CallNode(Identifier lhs, std::string name) : lhs(lhs), name(name) { def.emplace(lhs.ident); }
+    std::string getName() { return name; }
+    Identifier getLhs() { return lhs; }
     int saveContextSize(GenerateTable *table);
     void saveContext(GenerateTable *table, AssemblyNode *&tail);
     void loadContext(GenerateTable *table, AssemblyNode *&tail);
 
    protected:
     Identifier lhs;
+    std::string name;
     std::vector<std::string> savedIdent;
 };
 
 class CallWithRet : public CallNode {
    public:
-    CallWithRet(Identifier lhs, std::string name) : CallNode(lhs), name(name) {}
+    CallWithRet(Identifier lhs, std::string name) : CallNode(lhs, name) {}
     void print() override;
     int prologue(GenerateTable *table) override {
         table->curArgCount = 0;
         return 0;
     }
     void generate(GenerateTable *table, AssemblyNode *&tail) override;
-
-   private:
-    std::string name;
+    IRNode *clone() override { return cloneNode(this); }
+    void renameDef(std::string from, std::string to) override;
 };
 
 class Call : public CallNode {
    public:
-    Call(std::string name) : name(name) {}
+    Call(std::string name) : CallNode(name) {}
     void print() override;
     int prologue(GenerateTable *table) override {
         table->curArgCount = 0;
         return 0;
     }
     void generate(GenerateTable *table, AssemblyNode *&tail) override;
-
-   private:
-    std::string name;
+    IRNode *clone() override { return cloneNode(this); }
 };
 
 class Param : public IRNode {
@@ -278,6 +357,8 @@ class Param : public IRNode {
     int prologue(GenerateTable *table) override;
     void generate(GenerateTable *table, AssemblyNode *&tail) override;
 
+    Identifier getIdent() { return ident; }
+
    private:
     Identifier ident;
 };
@@ -288,6 +369,10 @@ class Arg : public IRNode {
     void print() override;
     int prologue(GenerateTable *table) override;
     void generate(GenerateTable *table, AssemblyNode *&tail) override;
+    IRNode *clone() override { return cloneNode(this); }
+    void renameUse(std::string from, std::string to) override;
+
+    Identifier getIdent() { return ident; }
 
    private:
     Identifier ident;
@@ -299,6 +384,9 @@ class ReturnWithVal : public IRNode {
     void print() override;
     bool livenessAnalysis(GenerateTable *table) override { return _livenessAnalysis(nullptr); }
     void generate(GenerateTable *table, AssemblyNode *&tail) override;
+    void renameUse(std::string from, std::string to) override;
+
+    Identifier getIdent() { return ident; }
 
    private:
     Identifier ident;
@@ -322,6 +410,9 @@ class VarDec : public IRNode {
     }
     void generate(GenerateTable *table, AssemblyNode *&tail) override;
 
+    Identifier getIdent() { return ident; }
+    Immediate getSize() { return size; }
+
    private:
     Identifier ident;
     Immediate size;
@@ -333,28 +424,121 @@ class GlobalVar : public IRNode {
     void print() override;
     void generate(GenerateTable *table, AssemblyNode *&tail) override;
 
+    Identifier getIdent() { return ident; }
+
    private:
     Identifier ident;
 };
 
 class LoadGlobal : public IRNode {
    public:
-    LoadGlobal(Identifier lhs, Identifier rhs) : lhs(lhs), rhs(rhs) {}
+    LoadGlobal(Identifier lhs, Identifier rhs) : lhs(lhs), rhs(rhs) { def.emplace(lhs.ident); }
     void print() override;
     void generate(GenerateTable *table, AssemblyNode *&tail) override;
+    IRNode *clone() override { return cloneNode(this); }
+    void renameDef(std::string from, std::string to) override;
+
+    Identifier getLhs() { return lhs; }
+    Identifier getRhs() { return rhs; }
 
    private:
     Identifier lhs, rhs;
 };
 
+// consecutive words of global data
 class Word : public IRNode {
    public:
-    Word(Immediate imm) : imm(imm) {}
+    Word(Immediate imm) : values({imm.value}) {}
+    Word(std::vector<int> values) : values(values) {}
     void print() override;
     void generate(GenerateTable *table, AssemblyNode *&tail) override;
 
+    std::vector<int> getValues() { return values; }
+
    private:
-    Immediate imm;
+    std::vector<int> values;
+};
+
+// a run of zero bytes in global data
+class Zero : public IRNode {
+   public:
+    Zero(Immediate size) : size(size) {}
+    void print() override;
+    void generate(GenerateTable *table, AssemblyNode *&tail) override;
+
+    Immediate getSize() { return size; }
+
+   private:
+    Immediate size;
+};
+
+class BitSet {
+   public:
+    BitSet(int size = 0, bool value = false) : words((size + 63) / 64, value ? ~0ull : 0ull) {}
+    bool test(int i) const { return words[i >> 6] >> (i & 63) & 1; }
+    void set(int i) { words[i >> 6] |= 1ull << (i & 63); }
+    void reset(int i) { words[i >> 6] &= ~(1ull << (i & 63)); }
+    bool operator==(const BitSet &other) const { return words == other.words; }
+    bool operator!=(const BitSet &other) const { return words != other.words; }
+    BitSet &operator&=(const BitSet &other) {
+        for (auto i = 0ull; i < words.size(); ++i) {
+            words[i] &= other.words[i];
+        }
+        return *this;
+    }
+    BitSet &operator|=(const BitSet &other) {
+        for (auto i = 0ull; i < words.size(); ++i) {
+            words[i] |= other.words[i];
+        }
+        return *this;
+    }
+
+   private:
+    std::vector<unsigned long long> words;
+};
+
+class BasicBlock {
+   public:
+    std::vector<IRNode *> nodes;
+    std::vector<int> succ, pred;
+};
+
+// control flow graph of one function, used by the optimization passes
+class FlowGraph {
+   public:
+    FlowGraph(FuncDefNode *func);
+    void relink();  // write the (modified) blocks back into the IRNode list
+
+    FuncDefNode *func;
+    IRNode *end;  // the first IRNode after the function
+    std::vector<BasicBlock> blocks;
+    std::unordered_map<std::string, int> labelBlock;  // label -> index of block
+};
+
+extern int unrollFactor;  // partial loop unrolling factor, 1 disables it
+extern bool graphColoring;  // allocate registers by graph coloring instead of linear scan
+extern bool preSchedule;    // reorder each basic block of the IR for fewer live values before register allocation
+extern bool postSchedule;   // reorder each basic block of the assembly for the pipeline
+// add a counter to each block of the translated program, dumped by PROFILE_TEXT on exit
+void instrumentProfile(IRNode *root);
+// set the count of each node of the translated program from the output of its instrumented build
+void applyProfile(IRNode *root, FILE *profile);
+// optimize the functions not named in `optimized`, whose IR is final
+void optimize(IRNode *root, const std::unordered_set<std::string> &optimized = {});
+// read the IR printed by IRNode::print, or written by writeBinaryIR, into the list after a new head node
+IRNode *readIR(FILE *file);
+IRNode *readIR(const std::string &data);
+void writeBinaryIR(IRNode *root, FILE *file);  // the IR after the head node root, in a compact binary form
+// run the program as ir.py does, `read` from input and `write` to output, and return what main returns;
+// with profile set, each node's count becomes the times it ran, a FUNCTION's the times it was called
+int interpretIR(IRNode *root, FILE *input, FILE *output, bool profile = false);
+// code of a function reused from an earlier compilation instead of being generated again
+struct CachedFunction {
+    std::string assembly;
+    std::unordered_set<int> clobbers;
 };
+// generate the functions from root on, callees first so that each call knows what its callee clobbers
+void generateFunctions(IRNode *root, GenerateTable *table, AssemblyNode *&tail,
+                       const std::unordered_map<std::string, CachedFunction> &cached = {});
 
 #endif
\ No newline at end of file
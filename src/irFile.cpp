@@ -0,0 +1,494 @@
+#include "ir.h"
+#include <cctype>
+#include <climits>
+#include <cstring>
+
+// the binary IR: magic, string table, then each node as its kind and operands,
+// strings as indices into the table and numbers as zigzag varints
+const char BINARY_MAGIC[] = "SYIR\x01";
+const size_t BINARY_MAGIC_SIZE = 5;
+
+enum NodeKind {
+    LOAD_IMM,
+    ASSIGN,
+    BINOP,
+    BINOP_IMM,
+    UNOP,
+    LOAD,
+    STORE,
+    LABEL,
+    GOTO,
+    COND_GOTO,
+    FUNCTION,
+    CALL_WITH_RET,
+    CALL,
+    PARAM,
+    ARG,
+    RETURN_WITH_VAL,
+    RETURN,
+    VAR_DEC,
+    GLOBAL_VAR,
+    LOAD_GLOBAL,
+    WORD,
+    ZERO,
+};
+
+class BinaryWriter {
+   public:
+    void kind(NodeKind kind) { bytes.push_back(static_cast<char>(kind)); }
+    void number(long long value) {
+        unsigned long long zigzag = value < 0 ? ~(static_cast<unsigned long long>(value) << 1)
+                                              : static_cast<unsigned long long>(value) << 1;
+        varint(zigzag);
+    }
+    void string(const std::string &value) {
+        auto it = stringIndex.find(value);
+        if (it == stringIndex.end()) {
+            it = stringIndex.emplace(value, strings.size()).first;
+            strings.push_back(value);
+        }
+        varint(it->second);
+    }
+    void varint(unsigned long long value) {
+        while (value >= 0x80) {
+            bytes.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        bytes.push_back(static_cast<char>(value));
+    }
+
+    std::string bytes;
+    std::vector<std::string> strings;
+    std::unordered_map<std::string, int> stringIndex;
+};
+
+class BinaryReader {
+   public:
+    BinaryReader(const std::string &data, size_t pos) : data(data), pos(pos) {}
+    unsigned long long varint() {
+        unsigned long long value = 0;
+        for (int shift = 0;; shift += 7) {
+            if (pos >= data.size() || shift > 63) {
+                throw std::runtime_error("truncated binary IR");
+            }
+            unsigned char c = data[pos++];
+            value |= static_cast<unsigned long long>(c & 0x7f) << shift;
+            if (!(c & 0x80)) {
+                return value;
+            }
+        }
+    }
+    int number() {
+        unsigned long long zigzag = varint();
+        return static_cast<int>(zigzag & 1 ? ~(zigzag >> 1) : zigzag >> 1);
+    }
+    std::string string() {
+        unsigned long long index = varint();
+        if (index >= strings.size()) {
+            throw std::runtime_error("bad string index in binary IR");
+        }
+        return strings[index];
+    }
+    NodeKind kind() {
+        if (pos >= data.size()) {
+            throw std::runtime_error("truncated binary IR");
+        }
+        return static_cast<NodeKind>(data[pos++]);
+    }
+
+    const std::string &data;
+    size_t pos;
+    std::vector<std::string> strings;
+};
+
+void writeBinaryIR(IRNode *root, FILE *file) {
+    BinaryWriter writer;
+    unsigned long long count = 0;
+    for (IRNode *cur = root->next; cur != nullptr; cur = cur->next, ++count) {
+        if (typeid(*cur) == typeid(LoadImm)) {
+            LoadImm *node = static_cast<LoadImm *>(cur);
+            writer.kind(LOAD_IMM);
+            writer.string(node->getIdent().ident);
+            writer.number(node->getValue().value);
+        } else if (typeid(*cur) == typeid(Assign)) {
+            Assign *node = static_cast<Assign *>(cur);
+            writer.kind(ASSIGN);
+            writer.string(node->getLhs().ident);
+            writer.string(node->getRhs().ident);
+        } else if (typeid(*cur) == typeid(Binop)) {
+            Binop *node = static_cast<Binop *>(cur);
+            writer.kind(BINOP);
+            writer.string(node->getLhs().ident);
+            writer.string(node->getRhs1().ident);
+            writer.string(node->getRhs2().ident);
+            writer.string(node->getOp());
+        } else if (typeid(*cur) == typeid(BinopImm)) {
+            BinopImm *node = static_cast<BinopImm *>(cur);
+            writer.kind(BINOP_IMM);
+            writer.string(node->getLhs().ident);
+            writer.string(node->getRhs().ident);
+            writer.number(node->getImm().value);
+            writer.string(node->getOp());
+        } else if (typeid(*cur) == typeid(Unop)) {
+            Unop *node = static_cast<Unop *>(cur);
+            writer.kind(UNOP);
+            writer.string(node->getLhs().ident);
+            writer.string(node->getRhs().ident);
+            writer.string(node->getOp());
+        } else if (typeid(*cur) == typeid(Load)) {
+            Load *node = static_cast<Load *>(cur);
+            writer.kind(LOAD);
+            writer.string(node->getLhs().ident);
+            writer.string(node->getRhs().ident);
+        } else if (typeid(*cur) == typeid(Store)) {
+            Store *node = static_cast<Store *>(cur);
+            writer.kind(STORE);
+            writer.string(node->getLhs().ident);
+            writer.string(node->getRhs().ident);
+        } else if (typeid(*cur) == typeid(Label)) {
+            writer.kind(LABEL);
+            writer.string(static_cast<Label *>(cur)->getName());
+        } else if (typeid(*cur) == typeid(Goto)) {
+            writer.kind(GOTO);
+            writer.string(static_cast<Goto *>(cur)->getLabel());
+        } else if (typeid(*cur) == typeid(CondGoto)) {
+            CondGoto *node = static_cast<CondGoto *>(cur);
+            writer.kind(COND_GOTO);
+            writer.string(node->getLhs().ident);
+            writer.string(node->getRhs().ident);
+            writer.string(node->getOp());
+            writer.string(node->getLabel());
+        } else if (typeid(*cur) == typeid(FuncDefNode)) {
+            writer.kind(FUNCTION);
+            writer.string(static_cast<FuncDefNode *>(cur)->getName());
+        } else if (typeid(*cur) == typeid(CallWithRet)) {
+            CallWithRet *node = static_cast<CallWithRet *>(cur);
+            writer.kind(CALL_WITH_RET);
+            writer.string(node->getLhs().ident);
+            writer.string(node->getName());
+        } else if (typeid(*cur) == typeid(Call)) {
+            writer.kind(CALL);
+            writer.string(static_cast<Call *>(cur)->getName());
+        } else if (typeid(*cur) == typeid(Param)) {
+            writer.kind(PARAM);
+            writer.string(static_cast<Param *>(cur)->getIdent().ident);
+        } else if (typeid(*cur) == typeid(Arg)) {
+            writer.kind(ARG);
+            writer.string(static_cast<Arg *>(cur)->getIdent().ident);
+        } else if (typeid(*cur) == typeid(ReturnWithVal)) {
+            writer.kind(RETURN_WITH_VAL);
+            writer.string(static_cast<ReturnWithVal *>(cur)->getIdent().ident);
+        } else if (typeid(*cur) == typeid(Return)) {
+            writer.kind(RETURN);
+        } else if (typeid(*cur) == typeid(VarDec)) {
+            VarDec *node = static_cast<VarDec *>(cur);
+            writer.kind(VAR_DEC);
+            writer.string(node->getIdent().ident);
+            writer.number(node->getSize().value);
+        } else if (typeid(*cur) == typeid(GlobalVar)) {
+            writer.kind(GLOBAL_VAR);
+            writer.string(static_cast<GlobalVar *>(cur)->getIdent().ident);
+        } else if (typeid(*cur) == typeid(LoadGlobal)) {
+            LoadGlobal *node = static_cast<LoadGlobal *>(cur);
+            writer.kind(LOAD_GLOBAL);
+            writer.string(node->getLhs().ident);
+            writer.string(node->getRhs().ident);
+        } else if (typeid(*cur) == typeid(Word)) {
+            std::vector<int> values = static_cast<Word *>(cur)->getValues();
+            writer.kind(WORD);
+            writer.varint(values.size());
+            for (auto value : values) {
+                writer.number(value);
+            }
+        } else if (typeid(*cur) == typeid(Zero)) {
+            writer.kind(ZERO);
+            writer.number(static_cast<Zero *>(cur)->getSize().value);
+        } else {
+            throw std::runtime_error("IR node without a binary form");
+        }
+    }
+
+    BinaryWriter header;
+    header.varint(writer.strings.size());
+    for (auto &string : writer.strings) {
+        header.varint(string.size());
+        header.bytes += string;
+    }
+    header.varint(count);
+    fwrite(BINARY_MAGIC, 1, BINARY_MAGIC_SIZE, file);
+    fwrite(header.bytes.data(), 1, header.bytes.size(), file);
+    fwrite(writer.bytes.data(), 1, writer.bytes.size(), file);
+}
+
+static IRNode *readBinaryIR(const std::string &data) {
+    BinaryReader reader(data, BINARY_MAGIC_SIZE);
+    unsigned long long strings = reader.varint();
+    for (auto i = 0ull; i < strings; ++i) {
+        unsigned long long size = reader.varint();
+        if (size > data.size() - reader.pos) {
+            throw std::runtime_error("truncated binary IR");
+        }
+        reader.strings.push_back(data.substr(reader.pos, size));
+        reader.pos += size;
+    }
+
+    IRNode *root = new IRNode(), *tail = root;
+    unsigned long long count = reader.varint();
+    for (auto i = 0ull; i < count; ++i) {
+        IRNode *node = nullptr;
+        switch (reader.kind()) {
+            case LOAD_IMM: {
+                std::string ident = reader.string();
+                node = new LoadImm(Identifier(ident), Immediate(reader.number()));
+                break;
+            }
+            case ASSIGN: {
+                std::string lhs = reader.string();
+                node = new Assign(Identifier(lhs), Identifier(reader.string()));
+                break;
+            }
+            case BINOP: {
+                std::string lhs = reader.string(), rhs1 = reader.string(), rhs2 = reader.string();
+                node = new Binop(Identifier(lhs), Identifier(rhs1), Identifier(rhs2), reader.string());
+                break;
+            }
+            case BINOP_IMM: {
+                std::string lhs = reader.string(), rhs = reader.string();
+                int imm = reader.number();
+                node = new BinopImm(Identifier(lhs), Identifier(rhs), Immediate(imm), reader.string());
+                break;
+            }
+            case UNOP: {
+                std::string lhs = reader.string(), rhs = reader.string();
+                node = new Unop(Identifier(lhs), Identifier(rhs), reader.string());
+                break;
+            }
+            case LOAD: {
+                std::string lhs = reader.string();
+                node = new Load(Identifier(lhs), Identifier(reader.string()));
+                break;
+            }
+            case STORE: {
+                std::string lhs = reader.string();
+                node = new Store(Identifier(lhs), Identifier(reader.string()));
+                break;
+            }
+            case LABEL:
+                node = new Label(reader.string());
+                break;
+            case GOTO:
+                node = new Goto(reader.string());
+                break;
+            case COND_GOTO: {
+                std::string lhs = reader.string(), rhs = reader.string(), op = reader.string();
+                node = new CondGoto(Identifier(lhs), Identifier(rhs), op, reader.string());
+                break;
+            }
+            case FUNCTION:
+                node = new FuncDefNode(Identifier(reader.string()));
+                break;
+            case CALL_WITH_RET: {
+                std::string lhs = reader.string();
+                node = new CallWithRet(Identifier(lhs), reader.string());
+                break;
+            }
+            case CALL:
+                node = new Call(reader.string());
+                break;
+            case PARAM:
+                node = new Param(Identifier(reader.string()));
+                break;
+            case ARG:
+                node = new Arg(Identifier(reader.string()));
+                break;
+            case RETURN_WITH_VAL:
+                node = new ReturnWithVal(Identifier(reader.string()));
+                break;
+            case RETURN:
+                node = new Return();
+                break;
+            case VAR_DEC: {
+                std::string ident = reader.string();
+                node = new VarDec(Identifier(ident), Immediate(reader.number()));
+                break;
+            }
+            case GLOBAL_VAR:
+                node = new GlobalVar(Identifier(reader.string()));
+                break;
+            case LOAD_GLOBAL: {
+                std::string lhs = reader.string();
+                node = new LoadGlobal(Identifier(lhs), Identifier(reader.string()));
+                break;
+            }
+            case WORD: {
+                std::vector<int> values(reader.varint());
+                for (auto &value : values) {
+                    value = reader.number();
+                }
+                node = new Word(values);
+                break;
+            }
+            case ZERO:
+                node = new Zero(Immediate(reader.number()));
+                break;
+            default:
+                throw std::runtime_error("unknown node kind in binary IR");
+        }
+        tail->next = node;
+        tail = node;
+    }
+    return root;
+}
+
+static std::vector<std::string> splitTokens(const std::string &line) {
+    std::vector<std::string> tokens;
+    size_t i = 0;
+    while (i < line.size()) {
+        while (i < line.size() && isspace(static_cast<unsigned char>(line[i]))) {
+            ++i;
+        }
+        size_t start = i;
+        while (i < line.size() && !isspace(static_cast<unsigned char>(line[i]))) {
+            ++i;
+        }
+        if (i > start) {
+            tokens.push_back(line.substr(start, i - start));
+        }
+    }
+    return tokens;
+}
+
+// `name:` of FUNCTION, LABEL and GLOBAL
+static std::string stripColon(const std::string &token) {
+    if (token.size() < 2 || token.back() != ':') {
+        throw std::runtime_error("expected a name followed by ':'");
+    }
+    return token.substr(0, token.size() - 1);
+}
+
+static int immediate(const std::string &token) {
+    if (token.size() < 2 || token[0] != '#') {
+        throw std::runtime_error("expected an immediate");
+    }
+    char *end;
+    long long value = strtoll(token.c_str() + 1, &end, 10);
+    if (*end != '\0' || value < INT_MIN || value > INT_MAX) {
+        throw std::runtime_error("bad immediate " + token);
+    }
+    return static_cast<int>(value);
+}
+
+// one line of the textual IR, nullptr for .WORD which is gathered by the caller
+static IRNode *parseLine(const std::vector<std::string> &tokens) {
+    const std::string &first = tokens[0];
+    size_t size = tokens.size();
+    if (first == "FUNCTION" && size == 2) {
+        return new FuncDefNode(Identifier(stripColon(tokens[1])));
+    } else if (first == "LABEL" && size == 2) {
+        return new Label(stripColon(tokens[1]));
+    } else if (first == "GLOBAL" && size == 2) {
+        return new GlobalVar(Identifier(stripColon(tokens[1])));
+    } else if (first == "GOTO" && size == 2) {
+        return new Goto(tokens[1]);
+    } else if (first == "IF" && size == 6 && tokens[4] == "GOTO") {
+        return new CondGoto(Identifier(tokens[1]), Identifier(tokens[3]), tokens[2], tokens[5]);
+    } else if (first == "RETURN" && size == 1) {
+        return new Return();
+    } else if (first == "RETURN" && size == 2) {
+        return new ReturnWithVal(Identifier(tokens[1]));
+    } else if (first == "CALL" && size == 2) {
+        return new Call(tokens[1]);
+    } else if (first == "PARAM" && size == 2) {
+        return new Param(Identifier(tokens[1]));
+    } else if (first == "ARG" && size == 2) {
+        return new Arg(Identifier(tokens[1]));
+    } else if (first == "DEC" && size == 3) {
+        return new VarDec(Identifier(tokens[1]), Immediate(immediate(tokens[2])));
+    } else if (first == ".ZERO" && size == 2) {
+        return new Zero(Immediate(immediate(tokens[1])));
+    } else if (first[0] == '*' && size == 3 && tokens[1] == "=") {
+        return new Store(Identifier(first.substr(1)), Identifier(tokens[2]));
+    } else if (size >= 3 && tokens[1] == "=") {
+        Identifier lhs(first);
+        const std::string &rhs = tokens[2];
+        if (size == 3) {
+            switch (rhs[0]) {
+                case '#':
+                    return new LoadImm(lhs, Immediate(immediate(rhs)));
+                case '*':
+                    return new Load(lhs, Identifier(rhs.substr(1)));
+                case '&':
+                    return new LoadGlobal(lhs, Identifier(rhs.substr(1)));
+                case '+':
+                case '-':
+                case '!':
+                    return new Unop(lhs, Identifier(rhs.substr(1)), rhs.substr(0, 1));
+                default:
+                    return new Assign(lhs, Identifier(rhs));
+            }
+        } else if (size == 4 && rhs == "CALL") {
+            return new CallWithRet(lhs, tokens[3]);
+        } else if (size == 5 && tokens[4][0] == '#') {
+            return new BinopImm(lhs, Identifier(rhs), Immediate(immediate(tokens[4])), tokens[3]);
+        } else if (size == 5) {
+            return new Binop(lhs, Identifier(rhs), Identifier(tokens[4]), tokens[3]);
+        }
+    }
+    throw std::runtime_error("unknown IR statement");
+}
+
+static IRNode *readTextIR(const std::string &data) {
+    IRNode *root = new IRNode(), *tail = root;
+    std::vector<int> words;  // consecutive .WORD lines form one Word
+    auto link = [&](IRNode *node) {
+        if (!words.empty()) {
+            tail->next = new Word(words);
+            tail = tail->next;
+            words.clear();
+        }
+        if (node) {
+            tail->next = node;
+            tail = node;
+        }
+    };
+    int lineno = 0;
+    for (size_t start = 0; start < data.size();) {
+        size_t end = data.find('\n', start);
+        if (end == std::string::npos) {
+            end = data.size();
+        }
+        std::vector<std::string> tokens = splitTokens(data.substr(start, end - start));
+        start = end + 1;
+        ++lineno;
+        if (tokens.empty()) {
+            continue;
+        }
+        try {
+            if (tokens[0] == ".WORD" && tokens.size() == 2) {
+                words.push_back(immediate(tokens[1]));
+            } else {
+                link(parseLine(tokens));
+            }
+        } catch (std::runtime_error &error) {
+            throw std::runtime_error("IR line " + std::to_string(lineno) + ": " + error.what());
+        }
+    }
+    link(nullptr);
+    return root;
+}
+
+IRNode *readIR(const std::string &data) {
+    if (data.compare(0, BINARY_MAGIC_SIZE, BINARY_MAGIC) == 0) {
+        return readBinaryIR(data);
+    }
+    return readTextIR(data);
+}
+
+IRNode *readIR(FILE *file) {
+    std::string data;
+    char buffer[1 << 16];
+    for (size_t size; (size = fread(buffer, 1, sizeof(buffer), file)) > 0;) {
+        data.append(buffer, size);
+    }
+    return readIR(data);
+}
@@ -1,6 +1,8 @@
 #include "ast.h"
+#include "cache.h"
 #include "common.h"
 #include <string.h>
+#include <stdlib.h>
 
 extern int yylineno;
 extern int yyparse();
@@ -12,33 +14,114 @@ char *inputFilename;
 FILE *inputFile, *outputFile, *immediateFile;
 
 int main(int argc, char **argv) {
+    // options come first, then the input and output files
+    const char *program = argv[0];
+    int argIndex = 1;
+    bool profileGenerate = false, fromIR = false, binaryIR = false, runIR = false;
+    bool peepholeOn = true, peepholeStats = false;
+    const char *profileUse = nullptr, *cacheDir = nullptr;
+    for (; argIndex < argc && strncmp(argv[argIndex], "--", 2) == 0; ++argIndex) {
+        if (strncmp(argv[argIndex], "--unroll=", 9) == 0) {
+            unrollFactor = atoi(argv[argIndex] + 9);
+        } else if (strcmp(argv[argIndex], "--regalloc=graph") == 0) {
+            graphColoring = true;
+        } else if (strcmp(argv[argIndex], "--regalloc=linear") == 0) {
+            graphColoring = false;
+        } else if (strcmp(argv[argIndex], "--schedule=none") == 0) {
+            preSchedule = postSchedule = false;
+        } else if (strcmp(argv[argIndex], "--schedule=post") == 0) {
+            preSchedule = false;
+            postSchedule = true;
+        } else if (strcmp(argv[argIndex], "--schedule=both") == 0) {
+            preSchedule = postSchedule = true;
+        } else if (strcmp(argv[argIndex], "--peephole=none") == 0) {
+            peepholeOn = false;
+        } else if (strcmp(argv[argIndex], "--peephole-stats") == 0) {
+            peepholeStats = true;
+        } else if (strncmp(argv[argIndex], "--latency=", 10) == 0) {
+            if (!setLatencies(argv[argIndex] + 10)) {
+                fprintf(stderr, "Unknown latency: %s\n", argv[argIndex] + 10);
+                return 1;
+            }
+        } else if (strcmp(argv[argIndex], "--profile-generate") == 0) {
+            profileGenerate = true;
+        } else if (strncmp(argv[argIndex], "--profile-use=", 14) == 0) {
+            profileUse = argv[argIndex] + 14;
+        } else if (strcmp(argv[argIndex], "--from-ir") == 0) {
+            fromIR = true;
+        } else if (strcmp(argv[argIndex], "--binary-ir") == 0) {
+            binaryIR = true;
+        } else if (strcmp(argv[argIndex], "--run-ir") == 0) {
+            runIR = true;
+        } else if (strncmp(argv[argIndex], "--cache=", 8) == 0) {
+            cacheDir = argv[argIndex] + 8;
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", argv[argIndex]);
+            return 1;
+        }
+    }
+    argc -= argIndex - 1;
+    argv += argIndex - 1;
     if (argc < 2 || argc > 3) {
-        fprintf(stderr, "Usage: %s <input file> [<output file>]\n", argv[0]);
+        fprintf(stderr,
+                "Usage: %s [--unroll=<factor>] [--regalloc=linear|graph] [--schedule=none|post|both] "
+                "[--latency=<kind>=<cycles>,...] [--peephole=none] [--peephole-stats] [--profile-generate | --profile-use=<output file of the instrumented "
+                "program>] [--from-ir] [--binary-ir] [--cache=<directory>] [--run-ir] <input file> [<output file>]\n",
+                program);
+        return 1;
+    }
+    if (fromIR && (profileGenerate || profileUse)) {
+        fprintf(stderr, "--from-ir cannot be combined with the profile options\n");
+        return 1;
+    }
+    if (fromIR && cacheDir) {
+        fprintf(stderr, "--from-ir cannot be combined with --cache\n");
+        return 1;
+    }
+    if (runIR && (argc != 2 || binaryIR || cacheDir)) {
+        fprintf(stderr, "--run-ir writes no files\n");
+        return 1;
+    }
+    if (binaryIR && argc != 3) {
+        fprintf(stderr, "--binary-ir needs an output file\n");
         return 1;
     }
 
     inputFilename = argv[1];
-    inputFile = fopen(argv[1], "r");
+    inputFile = fopen(argv[1], fromIR ? "rb" : "r");
     if (!inputFile) {
         perror(argv[1]);
         return -1;
     }
-    // extern int yydebug;
-    // yydebug = 1;
-    yylineno = 1;
-    yyrestart(inputFile);
-    yyparse();
+    // IR printed by an earlier run, already optimized, goes straight to code generation
+    IRNode *irRoot = nullptr;
+    CompileCache *cache = nullptr;
+    if (fromIR) {
+        try {
+            irRoot = readIR(inputFile);
+        } catch (const std::runtime_error &error) {
+            fprintf(stderr, "%s\n", error.what());
+            fclose(inputFile);
+            return 1;
+        }
+    } else {
+        // extern int yydebug;
+        // yydebug = 1;
+        yylineno = 1;
+        yyrestart(inputFile);
+        yyparse();
 
-    Table *globalTable = new Table();
-    if (root) {
-        // root->print();
-        root->typeCheck(globalTable);
-    }
-    delete globalTable;
-    if (errorFlag) {
-        fclose(inputFile);
-        inputFile = nullptr;
-        return 1;
+        Table *globalTable = new Table();
+        if (root) {
+            // root->print();
+            root->typeCheck(globalTable);
+        }
+        delete globalTable;
+        if (errorFlag) {
+            fclose(inputFile);
+            inputFile = nullptr;
+            return 1;
+        }
     }
 
     outputFile = argc == 3 ? fopen(argv[2], "w") : stdout;
@@ -46,19 +129,75 @@ int main(int argc, char **argv) {
         perror(argv[2]);
         return -1;
     }
-    immediateFile = argc == 3 ? fopen(strcat(argv[2], ".ir"), "w") : stdout;
+    immediateFile = argc == 3 ? fopen(strcat(argv[2], ".ir"), binaryIR ? "wb" : "w") : stdout;
     if (!immediateFile) {
         perror(argv[2]);
         return -1;
     }
 
     // generate intermediate code
-    SymbolTable *symbolTable = new SymbolTable();
-    IRNode *irRoot = new IRNode(), *irTail = irRoot;
-    root->translateStmt(symbolTable, irTail);
-    delete symbolTable;
-    for (IRNode *ir = irRoot->next; ir != nullptr; ir = ir->next) {
-        ir->print();
+    if (!fromIR) {
+        SymbolTable *symbolTable = new SymbolTable();
+        irRoot = new IRNode();
+        IRNode *irTail = irRoot;
+        root->translateStmt(symbolTable, irTail);
+        delete symbolTable;
+        // the instrumented program writes its block counts after its own output, on exit
+        if (profileGenerate) {
+            instrumentProfile(irRoot);
+        } else if (profileUse) {
+            FILE *profileFile = fopen(profileUse, "r");
+            if (!profileFile) {
+                perror(profileUse);
+                return -1;
+            }
+            try {
+                applyProfile(irRoot, profileFile);
+            } catch (const std::runtime_error &error) {
+                fprintf(stderr, "%s\n", error.what());
+                fclose(profileFile);
+                return 1;
+            }
+            fclose(profileFile);
+        }
+        // functions unchanged since an earlier compilation into the same cache are neither optimized nor generated
+        if (cacheDir) {
+            std::string options = "1 unroll=" + std::to_string(unrollFactor) +
+                                  (graphColoring ? " regalloc=graph" : "") +
+                                  (profileGenerate ? " profile-generate" : "") +
+                                  (preSchedule ? " schedule=both" : postSchedule ? " schedule=post" : " schedule=none") +
+                                  (peepholeOn ? "" : " peephole=none");
+            for (auto &kind : std::map<std::string, int>(latencies.begin(), latencies.end())) {
+                options += " " + kind.first + "=" + std::to_string(kind.second);
+            }
+            cache = new CompileCache(cacheDir, options);
+            cache->load(irRoot);
+            optimize(irRoot, cache->getHits());
+        } else {
+            optimize(irRoot);
+        }
+    }
+    // run the IR instead of printing it and generating assembly, the program reading stdin
+    if (runIR) {
+        int result = 1;
+        try {
+            result = interpretIR(irRoot, stdin, stdout);
+        } catch (const std::runtime_error &error) {
+            fflush(stdout);
+            fprintf(stderr, "%s\n", error.what());
+        }
+        delete irRoot;
+        fclose(inputFile);
+        inputFile = nullptr;
+        delete root;
+        return result;
+    }
+    if (binaryIR) {
+        writeBinaryIR(irRoot, immediateFile);
+    } else {
+        for (IRNode *ir = irRoot->next; ir != nullptr; ir = ir->next) {
+            ir->print();
+        }
     }
 
     // generate assembly code
@@ -68,7 +207,8 @@ int main(int argc, char **argv) {
     fprintf(outputFile, "%s", DATA.c_str());
     IRNode *ir = irRoot->next;
     for (; ir != nullptr; ir = ir->next) {
-        if (typeid(*ir) == typeid(GlobalVar) || typeid(*ir) == typeid(Word)) {
+        if (typeid(*ir) == typeid(GlobalVar) || typeid(*ir) == typeid(Word) ||
+            typeid(*ir) == typeid(Zero)) {
             ir->generate(table, asmTail);
         } else {
             break;
@@ -81,13 +221,28 @@ int main(int argc, char **argv) {
     delete asmRoot;
     asmRoot = new AssemblyNode();
     asmTail = asmRoot;
-    fprintf(outputFile, "%s", TEXT.c_str());
-    for (; ir != nullptr; ir = ir->next) {
-        ir->generate(table, asmTail);
+    fprintf(outputFile, "%s", (profileGenerate ? PROFILE_TEXT : TEXT).c_str());
+    if (cache) {
+        generateFunctions(ir, table, asmTail, cache->getCached());
+    } else {
+        generateFunctions(ir, table, asmTail);
+    }
+    if (peepholeOn) {
+        peephole(asmRoot);
+    }
+    if (peepholeStats) {
+        for (auto &rule : peepholeHits()) {
+            fprintf(stderr, "peephole: %d x %s\n", rule.second, rule.first.c_str());
+        }
     }
     for (AssemblyNode *cur = asmRoot->next; cur != nullptr; cur = cur->next) {
         cur->print();
     }
+    if (cache) {
+        cache->store(irRoot, asmRoot, table);
+        fprintf(stderr, "cache: %zu hits, %d misses\n", cache->getHits().size(), cache->getMisses());
+        delete cache;
+    }
 
     delete irRoot;
     delete asmRoot;
@@ -0,0 +1,1992 @@
+#include "ir.h"
+#include <climits>
+#include <cstdlib>
+#include <set>
+#include <tuple>
+
+static bool isTerminator(IRNode *node) {
+    return typeid(*node) == typeid(Goto) || typeid(*node) == typeid(CondGoto) || typeid(*node) == typeid(Return) ||
+           typeid(*node) == typeid(ReturnWithVal);
+}
+
+static void deleteNode(IRNode *node) {
+    node->next = nullptr;
+    delete node;
+}
+
+FlowGraph::FlowGraph(FuncDefNode *func) : func(func), end(nullptr) {
+    blocks.emplace_back();
+    for (IRNode *cur = func->next; cur != nullptr; cur = cur->next) {
+        if (typeid(*cur) == typeid(FuncDefNode)) {
+            end = cur;
+            break;
+        }
+        if (typeid(*cur) == typeid(Label)) {
+            if (!blocks.back().nodes.empty()) {
+                blocks.emplace_back();
+            }
+            labelBlock[static_cast<Label *>(cur)->getName()] = blocks.size() - 1;
+        }
+        blocks.back().nodes.push_back(cur);
+        if (isTerminator(cur)) {
+            blocks.emplace_back();
+        }
+    }
+    if (blocks.size() > 1 && blocks.back().nodes.empty()) {
+        blocks.pop_back();
+    }
+
+    for (auto i = 0ull; i < blocks.size(); ++i) {
+        if (blocks[i].nodes.empty()) {
+            continue;
+        }
+        IRNode *last = blocks[i].nodes.back();
+        if (typeid(*last) == typeid(Goto)) {
+            blocks[i].succ.push_back(labelBlock.at(static_cast<Goto *>(last)->getLabel()));
+        } else if (typeid(*last) == typeid(Return) || typeid(*last) == typeid(ReturnWithVal)) {
+            // no successor
+        } else {
+            if (i + 1 < blocks.size()) {
+                blocks[i].succ.push_back(i + 1);
+            }
+            if (typeid(*last) == typeid(CondGoto)) {
+                int target = labelBlock.at(static_cast<CondGoto *>(last)->getLabel());
+                if (std::find(blocks[i].succ.begin(), blocks[i].succ.end(), target) == blocks[i].succ.end()) {
+                    blocks[i].succ.push_back(target);
+                }
+            }
+        }
+        for (auto j : blocks[i].succ) {
+            blocks[j].pred.push_back(i);
+        }
+    }
+}
+
+void FlowGraph::relink() {
+    IRNode *prev = func;
+    for (auto &block : blocks) {
+        for (auto node : block.nodes) {
+            prev->next = node;
+            prev = node;
+        }
+    }
+    prev->next = end;
+}
+
+// global copy propagation: for a copy x = y, replace uses of x with y wherever the copy is available,
+// i.e. neither x nor y has been redefined on any path. The copy itself is left to dead code elimination.
+static bool copyPropagation(FlowGraph &graph) {
+    std::vector<std::pair<std::string, std::string>> copies;  // lhs, rhs
+    std::unordered_map<IRNode *, int> copyIndex;
+    std::unordered_map<std::string, std::vector<int>> related;  // ident -> copies it takes part in
+    std::unordered_set<std::string> params;
+    for (auto &block : graph.blocks) {
+        for (auto node : block.nodes) {
+            if (typeid(*node) == typeid(Param)) {
+                params.insert(node->def.begin(), node->def.end());
+            }
+            if (typeid(*node) != typeid(Assign)) {
+                continue;
+            }
+            Assign *assign = static_cast<Assign *>(node);
+            if (assign->getLhs().ident == assign->getRhs().ident) {
+                continue;
+            }
+            copyIndex[node] = copies.size();
+            related[assign->getLhs().ident].push_back(copies.size());
+            related[assign->getRhs().ident].push_back(copies.size());
+            copies.emplace_back(assign->getLhs().ident, assign->getRhs().ident);
+        }
+    }
+    if (copies.empty()) {
+        return false;
+    }
+
+    auto transfer = [&](IRNode *node, BitSet &avail) {
+        auto kill = [&](const std::string &ident) {
+            auto it = related.find(ident);
+            if (it != related.end()) {
+                for (auto i : it->second) {
+                    avail.reset(i);
+                }
+            }
+        };
+        for (auto &ident : node->def) {
+            kill(ident);
+        }
+        // an array may share its name with a scalar of a sibling scope
+        if (typeid(*node) == typeid(VarDec)) {
+            kill(static_cast<VarDec *>(node)->getIdent().ident);
+        }
+        auto it = copyIndex.find(node);
+        if (it != copyIndex.end()) {
+            avail.set(it->second);
+        }
+    };
+
+    int size = copies.size();
+    std::vector<BitSet> in(graph.blocks.size(), BitSet(size)), out(graph.blocks.size(), BitSet(size, true));
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto i = 0ull; i < graph.blocks.size(); ++i) {
+            BitSet avail(size, i != 0 && !graph.blocks[i].pred.empty());
+            for (auto j : graph.blocks[i].pred) {
+                avail &= out[j];
+            }
+            in[i] = avail;
+            for (auto node : graph.blocks[i].nodes) {
+                transfer(node, avail);
+            }
+            if (avail != out[i]) {
+                out[i] = avail;
+                changed = true;
+            }
+        }
+    }
+
+    changed = false;
+    for (auto i = 0ull; i < graph.blocks.size(); ++i) {
+        BitSet avail = in[i];
+        auto &nodes = graph.blocks[i].nodes;
+        for (auto j = 0ull; j < nodes.size(); ++j) {
+            IRNode *node = nodes[j];
+            std::vector<std::string> uses(node->use.begin(), node->use.end());
+            for (auto &ident : uses) {
+                auto it = related.find(ident);
+                if (it == related.end()) {
+                    continue;
+                }
+                for (auto k : it->second) {
+                    if (!avail.test(k) || copies[k].first != ident) {
+                        continue;
+                    }
+                    // parameters live in argument registers, which are overwritten while passing arguments
+                    std::string source = copies[k].second;
+                    if (typeid(*node) != typeid(Arg) || params.find(source) == params.end()) {
+                        node->renameUse(ident, source);
+                        changed = true;
+                    }
+                    break;
+                }
+            }
+            transfer(node, avail);
+            if (typeid(*node) == typeid(Assign) &&
+                static_cast<Assign *>(node)->getLhs().ident == static_cast<Assign *>(node)->getRhs().ident) {
+                nodes.erase(nodes.begin() + j);
+                deleteNode(node);
+                --j;
+            }
+        }
+    }
+    return changed;
+}
+
+// idents live out of each block, numbered by identIndex
+static std::vector<BitSet> liveOut(FlowGraph &graph, std::unordered_map<std::string, int> &identIndex) {
+    identIndex.clear();
+    for (auto &block : graph.blocks) {
+        for (auto node : block.nodes) {
+            for (auto &ident : node->use) {
+                identIndex.emplace(ident, identIndex.size());
+            }
+            for (auto &ident : node->def) {
+                identIndex.emplace(ident, identIndex.size());
+            }
+        }
+    }
+
+    int size = identIndex.size();
+    std::vector<BitSet> in(graph.blocks.size(), BitSet(size)), out(graph.blocks.size(), BitSet(size));
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = graph.blocks.size() - 1; i >= 0; --i) {
+            BitSet live(size);
+            for (auto j : graph.blocks[i].succ) {
+                live |= in[j];
+            }
+            out[i] = live;
+            for (auto it = graph.blocks[i].nodes.rbegin(); it != graph.blocks[i].nodes.rend(); ++it) {
+                for (auto &ident : (*it)->def) {
+                    live.reset(identIndex[ident]);
+                }
+                for (auto &ident : (*it)->use) {
+                    live.set(identIndex[ident]);
+                }
+            }
+            if (live != in[i]) {
+                in[i] = live;
+                changed = true;
+            }
+        }
+    }
+    return out;
+}
+
+static bool deadCodeElimination(FlowGraph &graph) {
+    std::unordered_map<std::string, int> identIndex;
+    std::vector<BitSet> out = liveOut(graph, identIndex);
+    bool changed = false;
+    for (auto i = 0ull; i < graph.blocks.size(); ++i) {
+        BitSet live = out[i];
+        auto &nodes = graph.blocks[i].nodes;
+        for (int j = nodes.size() - 1; j >= 0; --j) {
+            IRNode *node = nodes[j];
+            bool useless = !node->def.empty() && typeid(*node) != typeid(Param) && typeid(*node) != typeid(CallWithRet);
+            for (auto &ident : node->def) {
+                useless &= !live.test(identIndex[ident]);
+                live.reset(identIndex[ident]);
+            }
+            if (useless) {
+                nodes.erase(nodes.begin() + j);
+                deleteNode(node);
+                changed = true;
+                continue;
+            }
+            for (auto &ident : node->use) {
+                live.set(identIndex[ident]);
+            }
+        }
+    }
+    return changed;
+}
+
+// evaluate `lhs op rhs` as the target does, false if the result is undefined
+static bool evaluate(int lhs, int rhs, std::string op, int &result) {
+    unsigned int a = lhs, b = rhs;
+    if (op == "+") {
+        result = a + b;
+    } else if (op == "-") {
+        result = a - b;
+    } else if (op == "*") {
+        result = a * b;
+    } else if (op == "/" || op == "%") {
+        if (rhs == 0 || (lhs == INT_MIN && rhs == -1)) {
+            return false;
+        }
+        result = op == "/" ? lhs / rhs : lhs % rhs;
+    } else if (op == "<") {
+        result = lhs < rhs;
+    } else if (op == ">") {
+        result = lhs > rhs;
+    } else if (op == "<=") {
+        result = lhs <= rhs;
+    } else if (op == ">=") {
+        result = lhs >= rhs;
+    } else if (op == "==") {
+        result = lhs == rhs;
+    } else if (op == "!=") {
+        result = lhs != rhs;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// simplify `lhs = rhs op #imm`, nullptr if nothing can be done
+static IRNode *simplifyImm(Identifier lhs, Identifier rhs, int imm, std::string op) {
+    if ((imm == 0 && (op == "+" || op == "-")) || (imm == 1 && (op == "*" || op == "/"))) {
+        return new Assign(lhs, rhs);
+    }
+    if ((imm == 0 && op == "*") || ((imm == 1 || imm == -1) && op == "%")) {
+        return new LoadImm(lhs, Immediate(0));
+    }
+    return nullptr;
+}
+
+// idents whose every definition is the same `x = #c`
+static std::unordered_map<std::string, int> findConstants(FlowGraph &graph) {
+    std::unordered_map<std::string, int> constants;
+    std::unordered_set<std::string> variables;
+    for (auto &block : graph.blocks) {
+        for (auto node : block.nodes) {
+            // an array may share its name with a scalar of a sibling scope
+            if (typeid(*node) == typeid(VarDec)) {
+                variables.insert(static_cast<VarDec *>(node)->getIdent().ident);
+            }
+            for (auto &ident : node->def) {
+                if (typeid(*node) != typeid(LoadImm)) {
+                    variables.insert(ident);
+                    continue;
+                }
+                int value = static_cast<LoadImm *>(node)->getValue().value;
+                auto it = constants.find(ident);
+                if (it == constants.end()) {
+                    constants[ident] = value;
+                } else if (it->second != value) {
+                    variables.insert(ident);
+                }
+            }
+        }
+    }
+    for (auto &ident : variables) {
+        constants.erase(ident);
+    }
+    return constants;
+}
+
+/*
+常量折叠: 所有定值都是同一个 `x = #c` 的变量视为常量. 两个操作数都是常量的运算直接求值,
+一个操作数是常量的运算改写为 BinopImm, 由后端选择带立即数的指令. 基本块内前面刚赋的常量同样参与折叠,
+两个操作数都是常量的条件跳转改写为 GOTO 或直接删除.
+*/
+static bool constantFolding(FlowGraph &graph) {
+    std::unordered_map<std::string, int> constants = findConstants(graph);
+    // constants of the whole function, and values known at the current point of a block
+    std::unordered_map<std::string, int> local;
+    auto isConstant = [&](Identifier &ident) {
+        return constants.find(ident.ident) != constants.end() || local.find(ident.ident) != local.end();
+    };
+    auto valueOf = [&](Identifier &ident) {
+        auto it = local.find(ident.ident);
+        return it != local.end() ? it->second : constants.at(ident.ident);
+    };
+    // operators whose operands can be exchanged, with the operator to use afterwards
+    static const std::unordered_map<std::string, std::string> swapped = {
+        {"+", "+"}, {"*", "*"}, {"<", ">"}, {">", "<"}, {"<=", ">="}, {">=", "<="}, {"==", "=="}, {"!=", "!="}};
+
+    bool changed = false;
+    for (auto &block : graph.blocks) {
+        local.clear();
+        for (auto j = 0ull; j < block.nodes.size(); ++j) {
+            IRNode *&node = block.nodes[j];
+            IRNode *replace = nullptr;
+            if (typeid(*node) == typeid(Assign)) {
+                Assign *assign = static_cast<Assign *>(node);
+                Identifier rhs = assign->getRhs();
+                if (isConstant(rhs)) {
+                    replace = new LoadImm(assign->getLhs(), Immediate(valueOf(rhs)));
+                }
+            } else if (typeid(*node) == typeid(Unop)) {
+                Unop *unop = static_cast<Unop *>(node);
+                Identifier rhs = unop->getRhs();
+                if (isConstant(rhs)) {
+                    unsigned int value = valueOf(rhs);
+                    int result = unop->getOp() == "-" ? -value : unop->getOp() == "!" ? value == 0 : value;
+                    replace = new LoadImm(unop->getLhs(), Immediate(result));
+                }
+            } else if (typeid(*node) == typeid(Binop)) {
+                Binop *binop = static_cast<Binop *>(node);
+                Identifier rhs1 = binop->getRhs1(), rhs2 = binop->getRhs2();
+                std::string op = binop->getOp();
+                int result;
+                if (isConstant(rhs1) && isConstant(rhs2)) {
+                    if (evaluate(valueOf(rhs1), valueOf(rhs2), op, result)) {
+                        replace = new LoadImm(binop->getLhs(), Immediate(result));
+                    }
+                } else if (isConstant(rhs2)) {
+                    replace = simplifyImm(binop->getLhs(), rhs1, valueOf(rhs2), op);
+                    if (replace == nullptr) {
+                        replace = new BinopImm(binop->getLhs(), rhs1, Immediate(valueOf(rhs2)), op);
+                    }
+                } else if (isConstant(rhs1) && swapped.find(op) != swapped.end()) {
+                    op = swapped.at(op);
+                    replace = simplifyImm(binop->getLhs(), rhs2, valueOf(rhs1), op);
+                    if (replace == nullptr) {
+                        replace = new BinopImm(binop->getLhs(), rhs2, Immediate(valueOf(rhs1)), op);
+                    }
+                }
+            } else if (typeid(*node) == typeid(BinopImm)) {
+                BinopImm *binop = static_cast<BinopImm *>(node);
+                Identifier rhs = binop->getRhs();
+                int result;
+                if (isConstant(rhs)) {
+                    if (evaluate(valueOf(rhs), binop->getImm().value, binop->getOp(), result)) {
+                        replace = new LoadImm(binop->getLhs(), Immediate(result));
+                    }
+                } else {
+                    replace = simplifyImm(binop->getLhs(), rhs, binop->getImm().value, binop->getOp());
+                }
+            } else if (typeid(*node) == typeid(CondGoto)) {
+                // a branch on constants is always or never taken
+                CondGoto *branch = static_cast<CondGoto *>(node);
+                Identifier lhs = branch->getLhs(), rhs = branch->getRhs();
+                int result;
+                if (isConstant(lhs) && isConstant(rhs) &&
+                    evaluate(valueOf(lhs), valueOf(rhs), branch->getOp(), result)) {
+                    if (!result) {
+                        deleteNode(node);
+                        block.nodes.erase(block.nodes.begin() + j);
+                        --j;
+                        changed = true;
+                        continue;
+                    }
+                    replace = new Goto(branch->getLabel());
+                }
+            }
+            if (replace != nullptr) {
+                deleteNode(node);
+                node = replace;
+                changed = true;
+                if (typeid(*node) == typeid(Assign) &&
+                    static_cast<Assign *>(node)->getLhs().ident == static_cast<Assign *>(node)->getRhs().ident) {
+                    deleteNode(node);
+                    block.nodes.erase(block.nodes.begin() + j);
+                    --j;
+                    continue;
+                }
+            }
+            if (typeid(*node) == typeid(LoadImm)) {
+                LoadImm *load = static_cast<LoadImm *>(node);
+                local[load->getIdent().ident] = load->getValue().value;
+                continue;
+            }
+            for (auto &ident : node->def) {
+                local.erase(ident);
+            }
+            if (typeid(*node) == typeid(VarDec)) {
+                local.erase(static_cast<VarDec *>(node)->getIdent().ident);
+            }
+        }
+    }
+    return changed;
+}
+
+static std::string firstLabel(BasicBlock &block) {
+    if (block.nodes.empty() || typeid(*block.nodes.front()) != typeid(Label)) {
+        return "";
+    }
+    return static_cast<Label *>(block.nodes.front())->getName();
+}
+
+static bool hasLabel(BasicBlock &block, std::string label) {
+    for (auto node : block.nodes) {
+        if (typeid(*node) != typeid(Label)) {
+            break;
+        }
+        if (static_cast<Label *>(node)->getName() == label) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// index of the first node after the leading labels
+static size_t bodyStart(BasicBlock &block) {
+    size_t i = 0;
+    while (i < block.nodes.size() && typeid(*block.nodes[i]) == typeid(Label)) {
+        ++i;
+    }
+    return i;
+}
+
+// times the block ran in the profile run, -1 without a profile, taken from its first node with a count
+// since jump threading appends copies of other blocks
+static long long blockCount(BasicBlock &block) {
+    for (auto node : block.nodes) {
+        if (node->count >= 0) {
+            return node->count;
+        }
+    }
+    return -1;
+}
+
+// the label finally reached by jumping to `label`, skipping empty blocks and jumps to jumps
+static std::string resolveLabel(FlowGraph &graph, std::string label) {
+    std::unordered_set<int> visited;
+    int cur = graph.labelBlock.at(label);
+    while (visited.insert(cur).second) {
+        BasicBlock &block = graph.blocks[cur];
+        size_t start = bodyStart(block);
+        if (start == block.nodes.size()) {
+            if (cur + 1 < static_cast<int>(graph.blocks.size()) && !firstLabel(graph.blocks[cur + 1]).empty()) {
+                cur = cur + 1;
+                continue;
+            }
+            break;
+        }
+        if (typeid(*block.nodes[start]) == typeid(Goto)) {
+            cur = graph.labelBlock.at(static_cast<Goto *>(block.nodes[start])->getLabel());
+            continue;
+        }
+        break;
+    }
+    return firstLabel(graph.blocks[cur]);
+}
+
+const int MAX_DUPLICATE_SIZE = 4;
+
+// temporaries used only inside the block get fresh names in a copy of it, so that the live ranges of the copies
+// do not stretch over the code between them
+static void renameLocals(FlowGraph &graph, int index, std::vector<IRNode *> &copy) {
+    static int copyCount = 0;
+    BasicBlock &block = graph.blocks[index];
+    std::unordered_set<std::string> defined, outside;
+    for (size_t i = bodyStart(block); i < block.nodes.size(); ++i) {
+        for (auto &ident : block.nodes[i]->use) {
+            if (defined.find(ident) == defined.end()) {
+                outside.insert(ident);
+            }
+        }
+        defined.insert(block.nodes[i]->def.begin(), block.nodes[i]->def.end());
+    }
+    for (auto i = 0ull; i < graph.blocks.size(); ++i) {
+        if (static_cast<int>(i) == index) {
+            continue;
+        }
+        for (auto node : graph.blocks[i].nodes) {
+            outside.insert(node->use.begin(), node->use.end());
+        }
+    }
+    ++copyCount;
+    for (auto &ident : defined) {
+        if (outside.find(ident) != outside.end()) {
+            continue;
+        }
+        std::string name = ident + "_" + std::to_string(copyCount);
+        for (auto node : copy) {
+            node->renameDef(ident, name);
+            node->renameUse(ident, name);
+        }
+    }
+}
+
+// copy of the code from `label` up to its first branch, ending with explicit jumps,
+// so that a jump to a loop condition can be replaced with the condition itself
+static std::vector<IRNode *> duplicateBlock(FlowGraph &graph, std::string label) {
+    int index = graph.labelBlock.at(label);
+    BasicBlock &block = graph.blocks[index];
+    size_t start = bodyStart(block);
+    if (start == block.nodes.size() || block.nodes.size() - start > MAX_DUPLICATE_SIZE ||
+        typeid(*block.nodes.back()) != typeid(CondGoto) || index + 1 == static_cast<int>(graph.blocks.size())) {
+        return {};
+    }
+    std::vector<IRNode *> copy;
+    for (size_t i = start; i < block.nodes.size(); ++i) {
+        IRNode *node = block.nodes[i]->clone();
+        if (node == nullptr) {
+            for (auto copied : copy) {
+                deleteNode(copied);
+            }
+            return {};
+        }
+        copy.push_back(node);
+    }
+    // the fall through successor becomes an explicit jump
+    BasicBlock &next = graph.blocks[index + 1];
+    if (!firstLabel(next).empty()) {
+        copy.push_back(new Goto(firstLabel(next)));
+    } else if (next.nodes.size() == 1 && typeid(*next.nodes.front()) == typeid(Goto)) {
+        copy.push_back(next.nodes.front()->clone());
+    } else {
+        for (auto copied : copy) {
+            deleteNode(copied);
+        }
+        return {};
+    }
+    renameLocals(graph, index, copy);
+
+    // a block jumping to itself would be copied again and again
+    for (auto node : copy) {
+        if ((typeid(*node) == typeid(Goto) && static_cast<Goto *>(node)->getLabel() == label) ||
+            (typeid(*node) == typeid(CondGoto) && static_cast<CondGoto *>(node)->getLabel() == label)) {
+            for (auto copied : copy) {
+                deleteNode(copied);
+            }
+            return {};
+        }
+    }
+    return copy;
+}
+
+/*
+分支布局优化: 跳转到跳转的穿透, 删除不可达块和无用标号, 把 `IF c GOTO L1; GOTO L2; LABEL L1:` 翻转为
+`IF !c GOTO L2`, 删除跳到下一块的跳转, 并把跳回循环条件的 GOTO 替换为条件本身 (循环只剩一次跳转).
+*/
+static bool layoutBranches(FlowGraph &graph) {
+    bool changed = false;
+    auto &blocks = graph.blocks;
+
+    // remove unreachable blocks
+    std::vector<bool> reachable(blocks.size(), false);
+    std::vector<int> stack = {0};
+    reachable[0] = true;
+    while (!stack.empty()) {
+        int cur = stack.back();
+        stack.pop_back();
+        for (auto succ : blocks[cur].succ) {
+            if (!reachable[succ]) {
+                reachable[succ] = true;
+                stack.push_back(succ);
+            }
+        }
+    }
+    for (auto i = 0ull; i < blocks.size(); ++i) {
+        if (!reachable[i] && !blocks[i].nodes.empty()) {
+            for (auto node : blocks[i].nodes) {
+                deleteNode(node);
+            }
+            blocks[i].nodes.clear();
+            changed = true;
+        }
+    }
+
+    // thread jumps, replace jumps to a small condition block with a copy of it
+    for (auto i = 0ull; i < blocks.size(); ++i) {
+        auto &nodes = blocks[i].nodes;
+        if (nodes.empty()) {
+            continue;
+        }
+        IRNode *last = nodes.back();
+        if (typeid(*last) == typeid(Goto)) {
+            Goto *jump = static_cast<Goto *>(last);
+            std::string target = resolveLabel(graph, jump->getLabel());
+            if (target != jump->getLabel()) {
+                jump->setLabel(target);
+                changed = true;
+            }
+            if (!hasLabel(blocks[i], target) && !(i + 1 < blocks.size() && hasLabel(blocks[i + 1], target))) {
+                std::vector<IRNode *> copy = duplicateBlock(graph, target);
+                if (!copy.empty()) {
+                    nodes.pop_back();
+                    deleteNode(last);
+                    nodes.insert(nodes.end(), copy.begin(), copy.end());
+                    changed = true;
+                }
+            }
+        } else if (typeid(*last) == typeid(CondGoto)) {
+            CondGoto *branch = static_cast<CondGoto *>(last);
+            std::string target = resolveLabel(graph, branch->getLabel());
+            if (target != branch->getLabel()) {
+                branch->setLabel(target);
+                changed = true;
+            }
+        }
+    }
+    if (changed) {
+        return true;
+    }
+
+    // create fall throughs and remove jumps to the next block
+    for (auto i = 0ull; i < blocks.size(); ++i) {
+        auto &nodes = blocks[i].nodes;
+        if (nodes.empty()) {
+            continue;
+        }
+        size_t nextIndex = i + 1;
+        while (nextIndex < blocks.size() && blocks[nextIndex].nodes.empty()) {
+            ++nextIndex;
+        }
+        if (nextIndex == blocks.size()) {
+            continue;
+        }
+        IRNode *last = nodes.back();
+        BasicBlock &next = blocks[nextIndex];
+        if (typeid(*last) == typeid(Goto) && hasLabel(next, static_cast<Goto *>(last)->getLabel())) {
+            nodes.pop_back();
+            deleteNode(last);
+            changed = true;
+        } else if (typeid(*last) == typeid(CondGoto)) {
+            CondGoto *branch = static_cast<CondGoto *>(last);
+            if (hasLabel(next, branch->getLabel())) {
+                nodes.pop_back();
+                deleteNode(last);
+                changed = true;
+                continue;
+            }
+            // IF c GOTO L1; GOTO L2; LABEL L1: => IF !c GOTO L2; LABEL L1:
+            size_t afterIndex = nextIndex + 1;
+            if (next.nodes.size() == 1 && typeid(*next.nodes.front()) == typeid(Goto) && afterIndex < blocks.size() &&
+                hasLabel(blocks[afterIndex], branch->getLabel())) {
+                branch->invert();
+                branch->setLabel(static_cast<Goto *>(next.nodes.front())->getLabel());
+                deleteNode(next.nodes.front());
+                next.nodes.clear();
+                changed = true;
+            }
+        }
+    }
+
+    // remove labels nobody jumps to
+    std::unordered_set<std::string> targets;
+    for (auto &block : blocks) {
+        if (block.nodes.empty()) {
+            continue;
+        }
+        IRNode *last = block.nodes.back();
+        if (typeid(*last) == typeid(Goto)) {
+            targets.insert(static_cast<Goto *>(last)->getLabel());
+        } else if (typeid(*last) == typeid(CondGoto)) {
+            targets.insert(static_cast<CondGoto *>(last)->getLabel());
+        }
+    }
+    for (auto &block : blocks) {
+        auto &nodes = block.nodes;
+        for (auto j = 0ull; j < nodes.size() && typeid(*nodes[j]) == typeid(Label); ++j) {
+            if (targets.find(static_cast<Label *>(nodes[j])->getName()) == targets.end()) {
+                deleteNode(nodes[j]);
+                nodes.erase(nodes.begin() + j);
+                --j;
+                changed = true;
+            }
+        }
+    }
+    return changed;
+}
+
+const int COLD_RATIO = 4;  // blocks skipped by a branch and run less than 1/COLD_RATIO as often are moved away
+
+/*
+冷块下沉 (需要 profile): 条件跳转 `IF c GOTO L` 跳过的一段块很少执行时, 把这段块移到函数末尾并以 `GOTO L`
+结束, 跳转改为 `IF !c GOTO` 这段块, 常走的路径顺序执行而不再跳转.
+*/
+static bool sinkColdBlocks(FlowGraph &graph) {
+    static int sinkCount = 0;
+    auto &blocks = graph.blocks;
+    // moved blocks go after the last one, which must not fall through
+    int last = blocks.size() - 1;
+    while (last >= 0 && blocks[last].nodes.empty()) {
+        --last;
+    }
+    if (last < 0 || (typeid(*blocks[last].nodes.back()) != typeid(Goto) &&
+                     typeid(*blocks[last].nodes.back()) != typeid(Return) &&
+                     typeid(*blocks[last].nodes.back()) != typeid(ReturnWithVal))) {
+        return false;
+    }
+    bool changed = false;
+    size_t size = blocks.size();
+    for (auto b = 0ull; b < size; ++b) {
+        auto &nodes = blocks[b].nodes;
+        long long hot = blockCount(blocks[b]);
+        if (nodes.empty() || typeid(*nodes.back()) != typeid(CondGoto) || hot <= 0) {
+            continue;
+        }
+        CondGoto *branch = static_cast<CondGoto *>(nodes.back());
+        size_t target = graph.labelBlock.at(branch->getLabel());
+        size_t first = b + 1, end;
+        while (first < target && blocks[first].nodes.empty()) {
+            ++first;
+        }
+        for (end = first; end < target; ++end) {
+            long long count = blockCount(blocks[end]);
+            if (!blocks[end].nodes.empty() && (count < 0 || count * COLD_RATIO >= hot)) {
+                break;
+            }
+        }
+        // the target must stay where the branch falls through to
+        if (first >= target || end < target || blocks[target].nodes.empty()) {
+            continue;
+        }
+
+        std::string label = firstLabel(blocks[first]);
+        if (label.empty()) {
+            label = branch->getLabel() + "_c" + std::to_string(++sinkCount);
+            blocks[first].nodes.insert(blocks[first].nodes.begin(), new Label(label));
+        }
+        BasicBlock cold;
+        for (size_t k = first; k < target; ++k) {
+            cold.nodes.insert(cold.nodes.end(), blocks[k].nodes.begin(), blocks[k].nodes.end());
+            blocks[k].nodes.clear();
+        }
+        if (!isTerminator(cold.nodes.back()) || typeid(*cold.nodes.back()) == typeid(CondGoto)) {
+            cold.nodes.push_back(new Goto(branch->getLabel()));
+        }
+        branch->invert();
+        branch->setLabel(label);
+        blocks.push_back(cold);
+        b = target - 1;
+        changed = true;
+    }
+    return changed;
+}
+
+int unrollFactor = 4;
+bool preSchedule = false;
+const int MAX_UNROLL_BODY = 32;        // larger loop bodies gain little from unrolling
+const int MAX_FULL_UNROLL_SIZE = 128;  // nodes a fully unrolled loop may take
+const int UNROLL_BUDGET = 256;         // nodes unrolling may add to a function
+
+// copies of the body of a single block loop, without its leading labels and closing branch
+static std::vector<IRNode *> copyLoopBody(FlowGraph &graph, int index) {
+    BasicBlock &block = graph.blocks[index];
+    std::vector<IRNode *> copy;
+    for (size_t i = bodyStart(block); i + 1 < block.nodes.size(); ++i) {
+        copy.push_back(block.nodes[i]->clone());
+    }
+    renameLocals(graph, index, copy);
+    return copy;
+}
+
+static bool compare(long long lhs, std::string op, long long rhs) {
+    return op == "<" ? lhs < rhs : op == "<=" ? lhs <= rhs : op == ">" ? lhs > rhs : lhs >= rhs;
+}
+
+/*
+循环展开: 只处理由单个基本块构成的 (已旋转的) 循环 `LABEL L: body; IF i op n GOTO L`, 其中 i 在循环体中
+只有一个定值 `i = i + #c`, n 是循环不变量. 进入循环时 i 为常量且 n 为常量时, 计算出迭代次数并完全展开;
+否则按 unrollFactor 展开为主循环, 每次检查剩余迭代是否足够, 不足时进入原循环处理余下的迭代:
+    lim = n - #(c * (k - 1))
+    IF lim 溢出 GOTO R
+    IF !(i op lim) GOTO R
+  LABEL M:
+    body * k
+    lim' = n - #(c * (k - 1))
+    IF i op lim' GOTO M
+    IF !(i op n) GOTO exit
+  LABEL R:
+    body
+    IF i op n GOTO R
+*/
+static bool unrollLoops(FlowGraph &graph) {
+    static int unrollCount = 0;
+    static const std::unordered_map<std::string, std::string> inverse = {
+        {"<", ">="}, {">=", "<"}, {">", "<="}, {"<=", ">"}};
+    static const std::unordered_map<std::string, std::string> swapped = {
+        {"<", ">"}, {">", "<"}, {"<=", ">="}, {">=", "<="}};
+    auto &blocks = graph.blocks;
+    std::unordered_map<std::string, int> constants = findConstants(graph);
+    int budget = UNROLL_BUDGET;
+    bool changed = false;
+    // with a profile the hottest loops get the budget first, and those hardly run are not partially unrolled
+    std::vector<size_t> order;
+    for (auto b = 0ull; b < blocks.size(); ++b) {
+        order.push_back(b);
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&](size_t x, size_t y) { return blockCount(blocks[x]) > blockCount(blocks[y]); });
+    for (auto b : order) {
+        auto &nodes = blocks[b].nodes;
+        size_t start = bodyStart(blocks[b]);
+        long long count = blockCount(blocks[b]);
+        if (nodes.size() < start + 2 || typeid(*nodes.back()) != typeid(CondGoto) ||
+            !hasLabel(blocks[b], static_cast<CondGoto *>(nodes.back())->getLabel()) ||
+            nodes.size() - start - 1 > MAX_UNROLL_BODY) {
+            continue;
+        }
+        int bodySize = nodes.size() - start - 1;
+        bool copyable = true;
+        for (size_t i = start; i + 1 < nodes.size() && copyable; ++i) {
+            IRNode *copy = nodes[i]->clone();
+            copyable = copy != nullptr;
+            if (copy) {
+                deleteNode(copy);
+            }
+        }
+        if (!copyable) {
+            continue;
+        }
+
+        // the induction variable and its bound
+        CondGoto *branch = static_cast<CondGoto *>(nodes.back());
+        std::string iv, bound, op;
+        int step = 0;
+        bool constantBound = false;
+        int boundValue = 0;
+        for (int side = 0; side < 2 && step == 0; ++side) {
+            iv = side == 0 ? branch->getLhs().ident : branch->getRhs().ident;
+            bound = side == 0 ? branch->getRhs().ident : branch->getLhs().ident;
+            op = side == 0 ? branch->getOp() : swapped.count(branch->getOp()) ? swapped.at(branch->getOp()) : "";
+            if (iv == bound || inverse.find(op) == inverse.end()) {
+                continue;
+            }
+            int ivDefs = 0, boundDefs = 0, increment = 0;
+            bool boundConst = true;
+            if (constants.find(bound) != constants.end()) {
+                boundValue = constants[bound];
+                ++boundDefs;
+            }
+            for (size_t i = start; i + 1 < nodes.size(); ++i) {
+                IRNode *node = nodes[i];
+                if (node->def.count(iv)) {
+                    ++ivDefs;
+                    if (typeid(*node) == typeid(BinopImm)) {
+                        BinopImm *binop = static_cast<BinopImm *>(node);
+                        if (binop->getRhs().ident == iv && (binop->getOp() == "+" || binop->getOp() == "-")) {
+                            increment = binop->getOp() == "+" ? binop->getImm().value : -binop->getImm().value;
+                        }
+                    }
+                }
+                if (node->def.count(bound)) {
+                    if (typeid(*node) != typeid(LoadImm) ||
+                        (boundDefs > 0 && static_cast<LoadImm *>(node)->getValue().value != boundValue)) {
+                        boundConst = false;
+                    } else {
+                        boundValue = static_cast<LoadImm *>(node)->getValue().value;
+                    }
+                    ++boundDefs;
+                }
+                if (typeid(*node) == typeid(VarDec)) {
+                    ivDefs += static_cast<VarDec *>(node)->getIdent().ident == iv;
+                    boundConst &= static_cast<VarDec *>(node)->getIdent().ident != bound;
+                }
+            }
+            bool increasing = op == "<" || op == "<=";
+            if (ivDefs == 1 && increment != 0 && (increment > 0) == increasing && boundConst) {
+                step = increment;
+                constantBound = boundDefs > 0;
+            }
+        }
+        if (step == 0) {
+            continue;
+        }
+        std::vector<IRNode *> unrolled(nodes.begin(), nodes.begin() + start);
+
+        // full unrolling, when the loop is entered only from the previous block with a constant induction variable
+        int trips = 0;
+        if (constantBound && b > 0 && blocks[b].pred.size() == 2 &&
+            std::find(blocks[b].pred.begin(), blocks[b].pred.end(), b - 1) != blocks[b].pred.end() &&
+            std::find(blocks[b].pred.begin(), blocks[b].pred.end(), b) != blocks[b].pred.end()) {
+            auto &prev = blocks[b - 1].nodes;
+            for (auto it = prev.rbegin(); it != prev.rend(); ++it) {
+                if ((*it)->def.count(iv) == 0) {
+                    continue;
+                }
+                if (typeid(**it) == typeid(LoadImm)) {
+                    long long value = static_cast<LoadImm *>(*it)->getValue().value + step;
+                    trips = 1;
+                    while (compare(value, op, boundValue) && trips * bodySize <= MAX_FULL_UNROLL_SIZE) {
+                        value += step;
+                        ++trips;
+                    }
+                    if (value < INT_MIN || value > INT_MAX ||
+                        trips * bodySize > std::min(MAX_FULL_UNROLL_SIZE, budget)) {
+                        trips = 0;
+                    }
+                }
+                break;
+            }
+        }
+        if (trips > 0) {
+            for (int i = 0; i < trips; ++i) {
+                std::vector<IRNode *> copy = copyLoopBody(graph, b);
+                unrolled.insert(unrolled.end(), copy.begin(), copy.end());
+            }
+            for (size_t i = start; i < nodes.size(); ++i) {
+                deleteNode(nodes[i]);
+            }
+            nodes = unrolled;
+            budget -= (trips - 1) * bodySize;
+            changed = true;
+            continue;
+        }
+
+        // partial unrolling, with the original loop left for the remaining iterations,
+        // not worth it when a call dominates the iteration anyway
+        bool hasCall = std::any_of(nodes.begin() + start, nodes.end(), [](IRNode *node) {
+            return typeid(*node) == typeid(Call) || typeid(*node) == typeid(CallWithRet);
+        });
+        int factor = hasCall || (count >= 0 && count < 2 * unrollFactor) ? 1 : unrollFactor;
+        while (factor > 1 && factor * bodySize > budget) {
+            --factor;
+        }
+        if (factor < 2) {
+            continue;
+        }
+        long long distance = static_cast<long long>(step) * (factor - 1);
+        long long limitValue = constantBound ? boundValue - distance : 0;
+        // n - distance must be an immediate, and the wraparound check below only catches a single wrap
+        if ((constantBound && (limitValue < INT_MIN || limitValue > INT_MAX)) || distance < INT_MIN ||
+            distance > INT_MAX) {
+            continue;
+        }
+        ++unrollCount;
+        std::string suffix = "_" + std::to_string(unrollCount);
+        std::string mainLabel = branch->getLabel() + "_u" + std::to_string(unrollCount);
+        std::string restLabel = branch->getLabel() + "_r" + std::to_string(unrollCount);
+        std::string exitLabel = b + 1 < blocks.size() ? firstLabel(blocks[b + 1]) : "";
+        bool newExit = exitLabel.empty();
+        if (newExit) {
+            exitLabel = branch->getLabel() + "_e" + std::to_string(unrollCount);
+        }
+        // lim and constant bounds are computed again next to each use, instead of living across the loop
+        auto loadLimit = [&](std::string limit) {
+            if (constantBound) {
+                unrolled.push_back(new LoadImm(Identifier(limit), Immediate(limitValue)));
+            } else {
+                unrolled.push_back(new BinopImm(Identifier(limit), Identifier(bound), Immediate(distance), "-"));
+            }
+        };
+        loadLimit("_lim" + suffix);
+        if (!constantBound) {
+            // lim wraps around when n is close to the end of the range of int
+            unrolled.push_back(
+                new CondGoto(Identifier("_lim" + suffix), Identifier(bound), step > 0 ? ">" : "<", restLabel));
+        }
+        unrolled.push_back(new CondGoto(Identifier(iv), Identifier("_lim" + suffix), inverse.at(op), restLabel));
+        unrolled.push_back(new Label(mainLabel));
+        for (int i = 0; i < factor; ++i) {
+            std::vector<IRNode *> copy = copyLoopBody(graph, b);
+            unrolled.insert(unrolled.end(), copy.begin(), copy.end());
+        }
+        loadLimit("_lim" + suffix + "_1");
+        unrolled.push_back(new CondGoto(Identifier(iv), Identifier("_lim" + suffix + "_1"), op, mainLabel));
+        std::string exitBound = bound;
+        if (constantBound) {
+            exitBound = "_bound" + suffix;
+            unrolled.push_back(new LoadImm(Identifier(exitBound), Immediate(boundValue)));
+        }
+        unrolled.push_back(new CondGoto(Identifier(iv), Identifier(exitBound), inverse.at(op), exitLabel));
+        unrolled.push_back(new Label(restLabel));
+        unrolled.insert(unrolled.end(), nodes.begin() + start, nodes.end());
+        branch->setLabel(restLabel);
+        if (newExit) {
+            unrolled.push_back(new Label(exitLabel));
+        }
+        nodes = unrolled;
+        budget -= factor * bodySize;
+        changed = true;
+    }
+    return changed;
+}
+
+const int MAX_SCALAR_ARRAY = 8;  // words of a local array that may be split into scalars
+
+// a local array, or an ident holding an address inside one
+struct ArrayAddress {
+    std::string array;
+    int offset;
+};
+
+/*
+标量替换: 局部数组的地址只用于常量下标的 Load/Store, 且不作为参数传出或存入内存时, 每个元素改为一个
+独立的变量 `_A_k`, 由寄存器分配放入寄存器. 地址 `p = A + #c` 只在基本块内追踪, 跨块使用的地址视为逃逸.
+DEC 改为各元素的 `_A_k = #0`, 多余的初始化由死代码消除删去.
+*/
+static bool scalarReplacement(FlowGraph &graph) {
+    auto &blocks = graph.blocks;
+    // small arrays declared once, not sharing their name with a scalar
+    std::unordered_map<std::string, int> arrays;
+    std::unordered_set<std::string> rejected;
+    for (auto &block : blocks) {
+        for (auto node : block.nodes) {
+            if (typeid(*node) == typeid(VarDec)) {
+                VarDec *dec = static_cast<VarDec *>(node);
+                std::string name = dec->getIdent().ident;
+                int words = dec->getSize().value / 4;
+                if (arrays.find(name) != arrays.end() || words <= 0 || words > MAX_SCALAR_ARRAY) {
+                    rejected.insert(name);
+                }
+                arrays[name] = words;
+            }
+            rejected.insert(node->def.begin(), node->def.end());
+        }
+    }
+    for (auto &name : rejected) {
+        arrays.erase(name);
+    }
+    if (arrays.empty()) {
+        return false;
+    }
+
+    // arrays each ident may point into somewhere in the function
+    std::unordered_map<std::string, std::unordered_set<std::string>> pointsTo;
+    for (auto &item : arrays) {
+        pointsTo[item.first].insert(item.first);
+    }
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (auto &block : blocks) {
+            for (auto node : block.nodes) {
+                if (typeid(*node) != typeid(Assign) && typeid(*node) != typeid(BinopImm)) {
+                    continue;
+                }
+                std::string source = *node->use.begin(), target = *node->def.begin();
+                auto it = pointsTo.find(source);
+                if (it == pointsTo.end()) {
+                    continue;
+                }
+                std::unordered_set<std::string> from = it->second;
+                auto &to = pointsTo[target];
+                for (auto &array : from) {
+                    changed |= to.insert(array).second;
+                }
+            }
+        }
+    }
+
+    // every Load/Store through an address, and the nodes computing the addresses
+    std::vector<std::pair<IRNode **, ArrayAddress>> accesses;
+    for (auto &block : blocks) {
+        std::unordered_map<std::string, ArrayAddress> address;
+        std::unordered_set<std::string> plain;  // idents redefined to a non-address in this block
+        auto resolve = [&](const std::string &ident, ArrayAddress &result) {
+            if (arrays.find(ident) != arrays.end()) {
+                result = {ident, 0};
+                return true;
+            }
+            auto it = address.find(ident);
+            if (it == address.end()) {
+                return false;
+            }
+            result = it->second;
+            return true;
+        };
+        auto escape = [&](const std::string &ident) {
+            ArrayAddress target;
+            if (resolve(ident, target)) {
+                rejected.insert(target.array);
+            } else if (pointsTo.find(ident) != pointsTo.end() && plain.find(ident) == plain.end()) {
+                rejected.insert(pointsTo[ident].begin(), pointsTo[ident].end());
+            }
+        };
+        auto access = [&](IRNode *&slot, const std::string &pointer) {
+            ArrayAddress target;
+            if (!resolve(pointer, target)) {
+                escape(pointer);
+                return;
+            }
+            if (target.offset < 0 || target.offset % 4 != 0 || target.offset / 4 >= arrays[target.array]) {
+                rejected.insert(target.array);
+            }
+            accesses.emplace_back(&slot, target);
+        };
+        for (auto &slot : block.nodes) {
+            IRNode *node = slot;
+            ArrayAddress target;
+            if (typeid(*node) == typeid(VarDec)) {
+                continue;
+            }
+            if (typeid(*node) == typeid(Assign) && resolve(static_cast<Assign *>(node)->getRhs().ident, target)) {
+                std::string lhs = static_cast<Assign *>(node)->getLhs().ident;
+                address[lhs] = target;
+                plain.erase(lhs);
+                accesses.emplace_back(&slot, target);
+                continue;
+            }
+            if (typeid(*node) == typeid(BinopImm)) {
+                BinopImm *binop = static_cast<BinopImm *>(node);
+                std::string op = binop->getOp();
+                if ((op == "+" || op == "-") && resolve(binop->getRhs().ident, target)) {
+                    target.offset += op == "+" ? binop->getImm().value : -binop->getImm().value;
+                    address[binop->getLhs().ident] = target;
+                    plain.erase(binop->getLhs().ident);
+                    accesses.emplace_back(&slot, target);
+                    continue;
+                }
+            }
+            if (typeid(*node) == typeid(Load)) {
+                access(slot, static_cast<Load *>(node)->getRhs().ident);
+            } else if (typeid(*node) == typeid(Store)) {
+                access(slot, static_cast<Store *>(node)->getLhs().ident);
+                escape(static_cast<Store *>(node)->getRhs().ident);
+            } else {
+                for (auto &ident : node->use) {
+                    escape(ident);
+                }
+            }
+            for (auto &ident : node->def) {
+                address.erase(ident);
+                plain.insert(ident);
+            }
+        }
+    }
+
+    bool changed = false;
+    auto element = [](const ArrayAddress &target) {
+        return Identifier("_" + target.array + "_" + std::to_string(target.offset / 4));
+    };
+    for (auto &item : accesses) {
+        IRNode *&slot = *item.first;
+        if (rejected.find(item.second.array) != rejected.end()) {
+            continue;
+        }
+        IRNode *replacement = nullptr;
+        if (typeid(*slot) == typeid(Load)) {
+            replacement = new Assign(static_cast<Load *>(slot)->getLhs(), element(item.second));
+        } else if (typeid(*slot) == typeid(Store)) {
+            replacement = new Assign(element(item.second), static_cast<Store *>(slot)->getRhs());
+        }
+        // address computations are left without uses
+        deleteNode(slot);
+        slot = replacement;
+        changed = true;
+    }
+    for (auto &block : blocks) {
+        std::vector<IRNode *> nodes;
+        for (auto node : block.nodes) {
+            if (node == nullptr) {
+                continue;
+            }
+            std::string name = typeid(*node) == typeid(VarDec) ? static_cast<VarDec *>(node)->getIdent().ident : "";
+            if (arrays.find(name) == arrays.end() || rejected.find(name) != rejected.end()) {
+                nodes.push_back(node);
+                continue;
+            }
+            for (int i = 0; i < arrays[name]; ++i) {
+                nodes.push_back(new LoadImm(element({name, i * 4}), Immediate(0)));
+            }
+            deleteNode(node);
+            changed = true;
+        }
+        block.nodes = nodes;
+    }
+    return changed;
+}
+
+// copy propagation, constant folding and dead code elimination, then branch layout, whether anything changed
+static bool simplify(FuncDefNode *func) {
+    FlowGraph graph(func);
+    bool simplified = false;
+    for (int i = 0; i < 8; ++i) {
+        bool changed = copyPropagation(graph);
+        changed |= constantFolding(graph);
+        simplified |= changed;
+        if (!changed) {
+            break;
+        }
+    }
+    while (deadCodeElimination(graph)) {
+        simplified = true;
+    }
+    graph.relink();
+    for (int i = 0; i < 16; ++i) {
+        FlowGraph layout(func);
+        bool changed = layoutBranches(layout);
+        layout.relink();
+        simplified |= changed;
+        if (!changed) {
+            break;
+        }
+    }
+    return simplified;
+}
+
+// an address as base + variable part + constant offset. The base is an array or global, or else the value number
+// of an unknown pointer prefixed with '%'. The variable part is a value number, -1 if there is none
+struct MemoryAddress {
+    std::string base;
+    int variable;
+    int offset;
+};
+
+struct MemoryEntry {
+    MemoryAddress address;
+    std::string value;  // ident holding the word at the address
+    int valueNumber;    // value number of that ident when recorded
+    IRNode **store;     // the store that wrote it while no load may have read it yet, nullptr otherwise
+};
+
+// value numbers, addresses and known memory contents at some point of a block
+struct MemoryState {
+    std::unordered_map<std::string, int> number;
+    std::map<std::tuple<std::string, int, int>, int> expressions;
+    std::unordered_map<int, MemoryAddress> address;
+    std::vector<MemoryEntry> entries;
+};
+
+static bool mustAlias(const MemoryAddress &a, const MemoryAddress &b) {
+    return a.base == b.base && a.variable == b.variable && a.offset == b.offset;
+}
+
+static bool mayAlias(const MemoryAddress &a, const MemoryAddress &b) {
+    if (a.base != b.base) {
+        // distinct arrays and globals never overlap
+        return a.base[0] == '%' || b.base[0] == '%';
+    }
+    return a.variable != b.variable || std::abs(a.offset - b.offset) < 4;
+}
+
+/*
+访存优化: 在基本块内 (以及只有一个前驱的后继块中) 对地址做值编号, 地址表示为 基址 + 变量部分 + 常量偏移.
+不同的局部数组与全局变量互不重叠, 基址与变量部分相同时按偏移判断是否重叠. 据此将已知内容的 Load
+改为赋值 (存储到读取的转发, 重复读取的消除), 并删除同一块内被覆盖且其间没有读取的 Store. 调用清空所有已知内容.
+*/
+static bool memoryOptimization(FlowGraph &graph) {
+    auto &blocks = graph.blocks;
+    // arrays declared in the function, not sharing their name with a scalar
+    std::unordered_set<std::string> arrays, defined;
+    for (auto &block : blocks) {
+        for (auto node : block.nodes) {
+            if (typeid(*node) == typeid(VarDec)) {
+                arrays.insert(static_cast<VarDec *>(node)->getIdent().ident);
+            }
+            defined.insert(node->def.begin(), node->def.end());
+        }
+    }
+    for (auto &ident : defined) {
+        arrays.erase(ident);
+    }
+
+    int count = 0;
+    bool changed = false;
+    std::vector<MemoryState> states(blocks.size());
+    for (auto b = 0ull; b < blocks.size(); ++b) {
+        MemoryState state;
+        if (blocks[b].pred.size() == 1 && static_cast<size_t>(blocks[b].pred[0]) < b) {
+            state = states[blocks[b].pred[0]];
+            // the other successor of the predecessor may read what it stored
+            for (auto &entry : state.entries) {
+                entry.store = nullptr;
+            }
+        }
+        auto numberOf = [&](const std::string &ident) {
+            auto it = state.number.find(ident);
+            if (it != state.number.end()) {
+                return it->second;
+            }
+            int number = count++;
+            state.number[ident] = number;
+            if (arrays.count(ident)) {
+                state.address[number] = {ident, -1, 0};
+            }
+            return number;
+        };
+        auto expression = [&](const std::string &op, int lhs, int rhs) {
+            if ((op == "+" || op == "*") && lhs > rhs) {
+                std::swap(lhs, rhs);
+            }
+            auto it = state.expressions.emplace(std::make_tuple(op, lhs, rhs), count);
+            count += it.second;
+            return it.first->second;
+        };
+        auto addressOf = [&](int number) {
+            auto it = state.address.find(number);
+            return it != state.address.end() ? it->second : MemoryAddress{"%" + std::to_string(number), -1, 0};
+        };
+        auto forget = [&](const MemoryAddress &address) {
+            std::vector<MemoryEntry> kept;
+            for (auto &entry : state.entries) {
+                if (!mayAlias(entry.address, address)) {
+                    kept.push_back(entry);
+                }
+            }
+            state.entries = kept;
+        };
+
+        auto &nodes = blocks[b].nodes;
+        for (auto &slot : nodes) {
+            IRNode *node = slot;
+            if (typeid(*node) == typeid(Load)) {
+                Load *load = static_cast<Load *>(node);
+                MemoryAddress address = addressOf(numberOf(load->getRhs().ident));
+                std::string lhs = load->getLhs().ident;
+                auto it = std::find_if(state.entries.begin(), state.entries.end(), [&](MemoryEntry &entry) {
+                    return mustAlias(entry.address, address) && numberOf(entry.value) == entry.valueNumber;
+                });
+                if (it != state.entries.end()) {
+                    slot = new Assign(load->getLhs(), Identifier(it->value));
+                    state.number[lhs] = it->valueNumber;
+                    deleteNode(node);
+                    changed = true;
+                    continue;
+                }
+                for (auto &entry : state.entries) {
+                    if (entry.store != nullptr && mayAlias(entry.address, address)) {
+                        entry.store = nullptr;
+                    }
+                }
+                state.number[lhs] = count++;
+                state.entries.push_back({address, lhs, state.number[lhs], nullptr});
+            } else if (typeid(*node) == typeid(Store)) {
+                Store *store = static_cast<Store *>(node);
+                MemoryAddress address = addressOf(numberOf(store->getLhs().ident));
+                for (auto &entry : state.entries) {
+                    if (entry.store != nullptr && mustAlias(entry.address, address)) {
+                        deleteNode(*entry.store);
+                        *entry.store = nullptr;
+                        changed = true;
+                    }
+                }
+                forget(address);
+                std::string rhs = store->getRhs().ident;
+                state.entries.push_back({address, rhs, numberOf(rhs), &slot});
+            } else if (typeid(*node) == typeid(Call) || typeid(*node) == typeid(CallWithRet)) {
+                state.entries.clear();
+                for (auto &ident : node->def) {
+                    state.number[ident] = count++;
+                }
+            } else if (typeid(*node) == typeid(VarDec)) {
+                // a new instance of the array
+                std::string name = static_cast<VarDec *>(node)->getIdent().ident;
+                if (arrays.count(name)) {
+                    forget({name, -1, 0});
+                }
+            } else if (typeid(*node) == typeid(Assign)) {
+                Assign *assign = static_cast<Assign *>(node);
+                state.number[assign->getLhs().ident] = numberOf(assign->getRhs().ident);
+            } else if (typeid(*node) == typeid(LoadGlobal)) {
+                LoadGlobal *load = static_cast<LoadGlobal *>(node);
+                int number = expression("&" + load->getRhs().ident, -1, -1);
+                state.number[load->getLhs().ident] = number;
+                state.address[number] = {load->getRhs().ident, -1, 0};
+            } else if (typeid(*node) == typeid(LoadImm)) {
+                LoadImm *load = static_cast<LoadImm *>(node);
+                state.number[load->getIdent().ident] = expression("#", load->getValue().value, -1);
+            } else if (typeid(*node) == typeid(BinopImm)) {
+                BinopImm *binop = static_cast<BinopImm *>(node);
+                int rhs = numberOf(binop->getRhs().ident), imm = binop->getImm().value;
+                int number = expression(binop->getOp() + "#", rhs, imm);
+                if (binop->getOp() == "+" || binop->getOp() == "-") {
+                    MemoryAddress address = addressOf(rhs);
+                    address.offset += binop->getOp() == "+" ? imm : -imm;
+                    state.address.emplace(number, address);
+                }
+                state.number[binop->getLhs().ident] = number;
+            } else if (typeid(*node) == typeid(Binop)) {
+                Binop *binop = static_cast<Binop *>(node);
+                int rhs1 = numberOf(binop->getRhs1().ident), rhs2 = numberOf(binop->getRhs2().ident);
+                int number = expression(binop->getOp(), rhs1, rhs2);
+                if (binop->getOp() == "+") {
+                    // the operand with a known address is the base, the other one is added to the variable part
+                    if (state.address.find(rhs1) == state.address.end() && state.address.count(rhs2)) {
+                        std::swap(rhs1, rhs2);
+                    }
+                    MemoryAddress address = addressOf(rhs1);
+                    address.variable = address.variable == -1 ? rhs2 : expression("+", address.variable, rhs2);
+                    state.address.emplace(number, address);
+                }
+                state.number[binop->getLhs().ident] = number;
+            } else {
+                for (auto &ident : node->def) {
+                    state.number[ident] = count++;
+                }
+            }
+        }
+        states[b] = state;
+
+        std::vector<IRNode *> kept;
+        for (auto node : nodes) {
+            if (node != nullptr) {
+                kept.push_back(node);
+            }
+        }
+        nodes = kept;
+    }
+    return changed;
+}
+
+// globals a function may read and write, itself or through its callees
+struct GlobalSummary {
+    std::unordered_set<std::string> mod, ref;
+    std::unordered_set<std::string> callees;
+};
+
+static bool isCall(IRNode *node) { return typeid(*node) == typeid(Call) || typeid(*node) == typeid(CallWithRet); }
+
+// idents holding the address of a global, from `p = &g`
+static std::unordered_map<std::string, std::string> globalAddresses(FlowGraph &graph,
+                                                                    std::unordered_set<std::string> &escaped) {
+    std::unordered_map<std::string, std::string> address;
+    std::unordered_set<std::string> other;
+    for (auto &block : graph.blocks) {
+        for (auto node : block.nodes) {
+            if (typeid(*node) != typeid(LoadGlobal)) {
+                other.insert(node->def.begin(), node->def.end());
+                continue;
+            }
+            LoadGlobal *load = static_cast<LoadGlobal *>(node);
+            auto it = address.emplace(load->getLhs().ident, load->getRhs().ident).first;
+            if (it->second != load->getRhs().ident) {
+                escaped.insert(it->second);
+                escaped.insert(load->getRhs().ident);
+            }
+        }
+    }
+    for (auto &ident : other) {
+        auto it = address.find(ident);
+        if (it != address.end()) {
+            escaped.insert(it->second);
+            address.erase(it);
+        }
+    }
+    // the address may only be dereferenced, anything else lets a global be accessed through a pointer
+    for (auto &block : graph.blocks) {
+        for (auto node : block.nodes) {
+            for (auto &ident : node->use) {
+                auto it = address.find(ident);
+                if (it == address.end()) {
+                    continue;
+                }
+                if ((typeid(*node) == typeid(Load) && static_cast<Load *>(node)->getRhs().ident == ident) ||
+                    (typeid(*node) == typeid(Store) && static_cast<Store *>(node)->getLhs().ident == ident &&
+                     static_cast<Store *>(node)->getRhs().ident != ident)) {
+                    continue;
+                }
+                escaped.insert(it->second);
+            }
+        }
+    }
+    return address;
+}
+
+// times each block ran in the profile run, or without a profile 8^depth of the loops around it,
+// loops found as backward branches in the layout
+static std::vector<long long> blockWeights(FlowGraph &graph) {
+    if (std::any_of(graph.blocks.begin(), graph.blocks.end(),
+                    [](BasicBlock &block) { return blockCount(block) >= 0; })) {
+        std::vector<long long> weight;
+        for (auto &block : graph.blocks) {
+            weight.push_back(std::max(blockCount(block), 0ll));
+        }
+        return weight;
+    }
+    // the last block branching back to each loop header
+    std::vector<int> loopEnd(graph.blocks.size(), -1), depth(graph.blocks.size(), 0);
+    std::vector<long long> weight;
+    for (auto i = 0ull; i < graph.blocks.size(); ++i) {
+        for (auto j : graph.blocks[i].succ) {
+            if (static_cast<size_t>(j) <= i) {
+                loopEnd[j] = std::max(loopEnd[j], static_cast<int>(i));
+            }
+        }
+    }
+    for (auto j = 0ull; j < graph.blocks.size(); ++j) {
+        for (int k = j; k <= loopEnd[j]; ++k) {
+            ++depth[k];
+        }
+    }
+    for (auto d : depth) {
+        weight.push_back(1 << std::min(3 * d, 15));
+    }
+    return weight;
+}
+
+/*
+全局变量提升: 只通过 `p = &g` 后直接解引用访问 (地址不逃逸) 的全局变量, 在函数内改为虚拟寄存器 `_g`.
+函数入口加载一次; 调用可能读写 g 的函数前, 若寄存器中的值可能已被修改则写回, 调用可能修改 g 的函数后重新加载;
+返回前同样写回. 各函数读写哪些全局变量由调用图上的传递闭包得到. 按循环深度估计的访存次数不减少时不提升.
+*/
+static void promoteGlobals(std::vector<FuncDefNode *> &funcs, const std::unordered_set<std::string> &optimized) {
+    std::unordered_map<std::string, GlobalSummary> summary;
+    std::unordered_set<std::string> escaped;
+    for (auto func : funcs) {
+        FlowGraph graph(func);
+        auto address = globalAddresses(graph, escaped);
+        GlobalSummary &own = summary[func->getName()];
+        for (auto &block : graph.blocks) {
+            for (auto node : block.nodes) {
+                if (typeid(*node) == typeid(Load) && address.count(static_cast<Load *>(node)->getRhs().ident)) {
+                    own.ref.insert(address[static_cast<Load *>(node)->getRhs().ident]);
+                } else if (typeid(*node) == typeid(Store) && address.count(static_cast<Store *>(node)->getLhs().ident)) {
+                    own.mod.insert(address[static_cast<Store *>(node)->getLhs().ident]);
+                } else if (isCall(node)) {
+                    own.callees.insert(static_cast<CallNode *>(node)->getName());
+                }
+            }
+        }
+    }
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (auto &item : summary) {
+            for (auto &callee : item.second.callees) {
+                auto it = summary.find(callee);
+                if (it == summary.end() || it->first == item.first) {
+                    continue;
+                }
+                for (auto &global : it->second.mod) {
+                    changed |= item.second.mod.insert(global).second;
+                }
+                for (auto &global : it->second.ref) {
+                    changed |= item.second.ref.insert(global).second;
+                }
+            }
+        }
+    }
+
+    for (auto func : funcs) {
+        if (optimized.count(func->getName())) {
+            continue;
+        }
+        FlowGraph graph(func);
+        std::unordered_set<std::string> ignored;
+        auto address = globalAddresses(graph, ignored);
+        std::vector<long long> weight = blockWeights(graph);
+        std::set<std::string> globals;
+        for (auto &item : address) {
+            if (!escaped.count(item.second)) {
+                globals.insert(item.second);
+            }
+        }
+        auto &blocks = graph.blocks;
+        long long entry = blockCount(blocks[0]) >= 0 ? weight[0] : 1;
+        bool promoted = false;
+        for (auto &global : globals) {
+            auto access = [&](IRNode *node, bool &isStore) {
+                if (typeid(*node) == typeid(Load)) {
+                    auto it = address.find(static_cast<Load *>(node)->getRhs().ident);
+                    isStore = false;
+                    return it != address.end() && it->second == global;
+                }
+                if (typeid(*node) == typeid(Store)) {
+                    auto it = address.find(static_cast<Store *>(node)->getLhs().ident);
+                    isStore = true;
+                    return it != address.end() && it->second == global;
+                }
+                return false;
+            };
+            // whether a call may write or read the global
+            auto callMod = [&](IRNode *node) {
+                auto it = summary.find(static_cast<CallNode *>(node)->getName());
+                return it != summary.end() && it->second.mod.count(global);
+            };
+            auto callRef = [&](IRNode *node) {
+                auto it = summary.find(static_cast<CallNode *>(node)->getName());
+                return it != summary.end() && it->second.ref.count(global);
+            };
+
+            // whether the register may hold a value not yet written back, at the end of each block
+            std::vector<bool> dirtyOut(blocks.size(), false);
+            auto dirtyIn = [&](size_t b) {
+                bool dirty = false;
+                for (auto p : blocks[b].pred) {
+                    dirty = dirty || dirtyOut[p];
+                }
+                return dirty;
+            };
+            for (bool changed = true; changed;) {
+                changed = false;
+                for (auto b = 0ull; b < blocks.size(); ++b) {
+                    bool dirty = dirtyIn(b), isStore;
+                    for (auto node : blocks[b].nodes) {
+                        if (access(node, isStore)) {
+                            dirty = dirty || isStore;
+                        } else if (isCall(node) && (callMod(node) || callRef(node))) {
+                            dirty = false;
+                        }
+                    }
+                    if (dirty != dirtyOut[b]) {
+                        dirtyOut[b] = dirty;
+                        changed = true;
+                    }
+                }
+            }
+
+            // memory accesses removed against those added, writing the register back lazily before the
+            // calls and returns that need it, or through to memory on every store; both pay the load on entry
+            long long lazy = -entry, through = -entry;
+            for (auto b = 0ull; b < blocks.size(); ++b) {
+                bool dirty = dirtyIn(b), isStore;
+                for (auto node : blocks[b].nodes) {
+                    if (access(node, isStore)) {
+                        lazy += weight[b];
+                        through += isStore ? 0 : weight[b];
+                        dirty = dirty || isStore;
+                    } else if (isCall(node) && (callMod(node) || callRef(node))) {
+                        lazy -= weight[b] * (dirty + callMod(node));
+                        through -= weight[b] * callMod(node);
+                        dirty = false;
+                    } else if (typeid(*node) == typeid(Return) || typeid(*node) == typeid(ReturnWithVal)) {
+                        lazy -= weight[b] * dirty;
+                    }
+                }
+            }
+            if (lazy <= 0 && through <= 0) {
+                continue;
+            }
+            bool writeThrough = through > lazy;
+            if (writeThrough) {
+                dirtyOut.assign(blocks.size(), false);
+            }
+
+            Identifier reg("_" + global), addr("_" + global + "_a0");
+            // before the arguments of a call, which are passed as a unit with it
+            auto writeBack = [&](std::vector<IRNode *> &nodes) {
+                auto it = nodes.end();
+                while (it != nodes.begin() && typeid(**(it - 1)) == typeid(Arg)) {
+                    --it;
+                }
+                it = nodes.insert(it, new LoadGlobal(addr, Identifier(global)));
+                nodes.insert(it + 1, new Store(addr, reg));
+            };
+            auto reload = [&](std::vector<IRNode *> &nodes) {
+                nodes.push_back(new LoadGlobal(addr, Identifier(global)));
+                nodes.push_back(new Load(reg, addr));
+            };
+            for (auto b = 0ull; b < blocks.size(); ++b) {
+                bool dirty = dirtyIn(b), isStore;
+                std::vector<IRNode *> nodes;
+                for (auto node : blocks[b].nodes) {
+                    if (access(node, isStore)) {
+                        if (isStore) {
+                            nodes.push_back(new Assign(reg, static_cast<Store *>(node)->getRhs()));
+                        } else {
+                            nodes.push_back(new Assign(static_cast<Load *>(node)->getLhs(), reg));
+                        }
+                        if (isStore && writeThrough) {
+                            nodes.push_back(node);
+                        } else {
+                            deleteNode(node);
+                        }
+                        dirty = dirty || (isStore && !writeThrough);
+                        continue;
+                    }
+                    bool isReturn = typeid(*node) == typeid(Return) || typeid(*node) == typeid(ReturnWithVal);
+                    bool accessed = isCall(node) && (callMod(node) || callRef(node));
+                    if (dirty && (isReturn || accessed)) {
+                        writeBack(nodes);
+                    }
+                    nodes.push_back(node);
+                    if (accessed) {
+                        if (callMod(node)) {
+                            reload(nodes);
+                        }
+                        dirty = false;
+                    }
+                }
+                blocks[b].nodes = nodes;
+            }
+            // load on entry, after the parameters
+            std::vector<IRNode *> entry;
+            reload(entry);
+            auto &first = blocks[0].nodes;
+            auto it = first.begin();
+            while (it != first.end() && typeid(**it) == typeid(Param)) {
+                ++it;
+            }
+            first.insert(it, entry.begin(), entry.end());
+            promoted = true;
+        }
+        if (promoted) {
+            graph.relink();
+            simplify(func);
+        }
+    }
+}
+
+/*
+寄存器分配前的指令调度: 在基本块内相邻的可交换结点 (计算, 取址, 访存) 中按依赖关系重排, 每次选择已就绪的结点中
+释放的活跃值 (最后一次使用且之后不活跃) 减去新定义的值最多者, 相同时保持原顺序, 使值的定义靠近使用, 减少
+同时活跃的值. 存储与其他访存保持顺序, 读取之间可以交换.
+*/
+static bool isSchedulable(IRNode *node) {
+    return typeid(*node) == typeid(LoadImm) || typeid(*node) == typeid(Assign) || typeid(*node) == typeid(Binop) ||
+           typeid(*node) == typeid(BinopImm) || typeid(*node) == typeid(Unop) || typeid(*node) == typeid(Load) ||
+           typeid(*node) == typeid(Store) || typeid(*node) == typeid(LoadGlobal);
+}
+
+static bool scheduleLiveValues(FlowGraph &graph) {
+    std::unordered_map<std::string, int> identIndex;
+    std::vector<BitSet> out = liveOut(graph, identIndex);
+    bool changed = false;
+    for (auto b = 0ull; b < graph.blocks.size(); ++b) {
+        auto &nodes = graph.blocks[b].nodes;
+        // idents live after each node
+        std::vector<std::unordered_set<std::string>> liveAfter(nodes.size());
+        std::unordered_set<std::string> live;
+        for (auto &ident : identIndex) {
+            if (out[b].test(ident.second)) {
+                live.insert(ident.first);
+            }
+        }
+        for (int i = nodes.size() - 1; i >= 0; --i) {
+            liveAfter[i] = live;
+            for (auto &ident : nodes[i]->def) {
+                live.erase(ident);
+            }
+            live.insert(nodes[i]->use.begin(), nodes[i]->use.end());
+        }
+
+        for (auto start = 0ull; start < nodes.size();) {
+            auto end = start;
+            while (end < nodes.size() && isSchedulable(nodes[end])) {
+                ++end;
+            }
+            if (end - start < 2) {
+                start = end + 1;
+                continue;
+            }
+            // dependences through idents and memory inside nodes[start, end)
+            int n = end - start;
+            std::vector<std::vector<int>> succ(n);
+            std::vector<int> predCount(n, 0);
+            std::unordered_map<std::string, int> remaining;
+            for (int i = 0; i < n; ++i) {
+                IRNode *node = nodes[start + i];
+                for (int j = 0; j < i; ++j) {
+                    IRNode *prev = nodes[start + j];
+                    bool memory = (typeid(*node) == typeid(Store) && (typeid(*prev) == typeid(Load) ||
+                                                                      typeid(*prev) == typeid(Store))) ||
+                                  (typeid(*node) == typeid(Load) && typeid(*prev) == typeid(Store));
+                    bool ident = false;
+                    for (auto &x : node->use) {
+                        ident |= prev->def.count(x) > 0;
+                    }
+                    for (auto &x : node->def) {
+                        ident |= prev->def.count(x) > 0 || prev->use.count(x) > 0;
+                    }
+                    if (memory || ident) {
+                        succ[j].push_back(i);
+                        ++predCount[i];
+                    }
+                }
+                for (auto &x : node->use) {
+                    ++remaining[x];
+                }
+            }
+            const std::unordered_set<std::string> &after = liveAfter[end - 1];
+            // live values the node ends minus the values it starts
+            auto score = [&](int i) {
+                IRNode *node = nodes[start + i];
+                int freed = 0;
+                for (auto &x : node->use) {
+                    freed += remaining[x] == 1 && !after.count(x) && !node->def.count(x) ? 1 : 0;
+                }
+                return freed - static_cast<int>(node->def.size());
+            };
+            std::vector<int> ready;
+            for (int i = 0; i < n; ++i) {
+                if (predCount[i] == 0) {
+                    ready.push_back(i);
+                }
+            }
+            std::vector<IRNode *> order;
+            while (!ready.empty()) {
+                auto best = ready.begin();
+                for (auto it = ready.begin(); it != ready.end(); ++it) {
+                    if (score(*it) > score(*best) || (score(*it) == score(*best) && *it < *best)) {
+                        best = it;
+                    }
+                }
+                int i = *best;
+                ready.erase(best);
+                order.push_back(nodes[start + i]);
+                for (auto &x : nodes[start + i]->use) {
+                    --remaining[x];
+                }
+                for (int j : succ[i]) {
+                    if (--predCount[j] == 0) {
+                        ready.push_back(j);
+                    }
+                }
+            }
+            for (int i = 0; i < n; ++i) {
+                changed |= nodes[start + i] != order[i];
+                nodes[start + i] = order[i];
+            }
+            start = end + 1;
+        }
+    }
+    return changed;
+}
+
+static std::vector<FuncDefNode *> functions(IRNode *root) {
+    std::vector<FuncDefNode *> funcs;
+    for (IRNode *cur = root; cur != nullptr; cur = cur->next) {
+        if (typeid(*cur) == typeid(FuncDefNode)) {
+            funcs.push_back(static_cast<FuncDefNode *>(cur));
+        }
+    }
+    return funcs;
+}
+
+// the counter k (from 1, word 0 holds their number) counts the k-th non-empty block of the translated program
+void instrumentProfile(IRNode *root) {
+    int counters = 0;
+    for (auto func : functions(root)) {
+        FlowGraph graph(func);
+        for (auto &block : graph.blocks) {
+            if (block.nodes.empty()) {
+                continue;
+            }
+            ++counters;
+            std::string suffix = std::to_string(counters);
+            Identifier address("_pa" + suffix), value("_pv" + suffix);
+            std::vector<IRNode *> increment = {
+                new LoadGlobal(address, Identifier(PROFILE_COUNTERS)),
+                new BinopImm(address, address, Immediate(counters * SIZE_OF_INT), "+"),
+                new Load(value, address),
+                new BinopImm(value, value, Immediate(1), "+"),
+                new Store(address, value),
+            };
+            auto it = block.nodes.begin();
+            while (it != block.nodes.end() && (typeid(**it) == typeid(Label) || typeid(**it) == typeid(Param))) {
+                ++it;
+            }
+            block.nodes.insert(it, increment.begin(), increment.end());
+        }
+        graph.relink();
+    }
+
+    std::vector<IRNode *> data = {new GlobalVar(Identifier(PROFILE_COUNTERS)), new Word(Immediate(counters))};
+    if (counters > 0) {
+        data.push_back(new Zero(Immediate(counters * SIZE_OF_INT)));
+    }
+    data.back()->next = root->next;
+    for (auto i = data.size() - 1; i > 0; --i) {
+        data[i - 1]->next = data[i];
+    }
+    root->next = data.front();
+}
+
+void applyProfile(IRNode *root, FILE *profile) {
+    // the words dumped on exit are the last fields of the output starting with '-'
+    std::vector<long long> fields;
+    bool inField = false;
+    for (int c = fgetc(profile); c != EOF; c = fgetc(profile)) {
+        if (c == '-') {
+            fields.push_back(0);
+            inField = true;
+        } else if (inField && c >= '0' && c <= '9') {
+            fields.back() = fields.back() * 10 + c - '0';
+        } else {
+            inField = false;
+        }
+    }
+
+    auto funcs = functions(root);
+    std::vector<FlowGraph> graphs;
+    size_t counters = 0;
+    for (auto func : funcs) {
+        graphs.emplace_back(func);
+        for (auto &block : graphs.back().blocks) {
+            counters += !block.nodes.empty();
+        }
+    }
+    if (fields.size() < counters + 1 || fields[fields.size() - counters - 1] != static_cast<long long>(counters) + 1) {
+        throw std::runtime_error("profile does not match the program");
+    }
+    auto field = fields.end() - counters;
+    for (auto &graph : graphs) {
+        for (auto &block : graph.blocks) {
+            if (block.nodes.empty()) {
+                continue;
+            }
+            for (auto node : block.nodes) {
+                node->count = *field - 1;
+            }
+            ++field;
+        }
+    }
+}
+
+void optimize(IRNode *root, const std::unordered_set<std::string> &optimized) {
+    std::vector<FuncDefNode *> funcs = functions(root), todo;
+    for (auto func : funcs) {
+        if (!optimized.count(func->getName())) {
+            todo.push_back(func);
+        }
+    }
+    for (auto func : todo) {
+        simplify(func);
+    }
+    // functions already optimized still tell the others which globals they access
+    promoteGlobals(funcs, optimized);
+    for (auto func : todo) {
+        FlowGraph arrays(func);
+        if (scalarReplacement(arrays)) {
+            arrays.relink();
+            simplify(func);
+        }
+        // unrolled loops expose constants and copies, fully unrolled ones merge with the code around them, which
+        // exposes more to the next round
+        FlowGraph loops(func);
+        if (unrollFactor > 1 && unrollLoops(loops)) {
+            loops.relink();
+            for (int i = 0; i < 8 && simplify(func); ++i) {
+            }
+            // fully unrolled loops index arrays with constants
+            FlowGraph unrolled(func);
+            if (scalarReplacement(unrolled)) {
+                unrolled.relink();
+                simplify(func);
+            }
+        }
+        FlowGraph memory(func);
+        if (memoryOptimization(memory)) {
+            memory.relink();
+            simplify(func);
+        }
+        FlowGraph layout(func);
+        if (sinkColdBlocks(layout)) {
+            layout.relink();
+            simplify(func);
+        }
+        if (preSchedule) {
+            FlowGraph schedule(func);
+            if (scheduleLiveValues(schedule)) {
+                schedule.relink();
+            }
+        }
+    }
+}
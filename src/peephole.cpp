@@ -0,0 +1,235 @@
+#include "assembly.h"
+#include <algorithm>
+#include <typeinfo>
+
+// the instructions after prev, at most count of them, fewer at the end of the list
+static std::vector<AssemblyNode *> window(AssemblyNode *prev, int count) {
+    std::vector<AssemblyNode *> nodes;
+    for (AssemblyNode *cur = prev->next; cur != nullptr && static_cast<int>(nodes.size()) < count; cur = cur->next) {
+        nodes.push_back(cur);
+    }
+    return nodes;
+}
+
+static bool contains(const std::vector<int> &regs, int reg) { return std::find(regs.begin(), regs.end(), reg) != regs.end(); }
+
+// unlink and delete the instruction after prev
+static void erase(AssemblyNode *prev) {
+    AssemblyNode *node = prev->next;
+    prev->next = node->next;
+    node->next = nullptr;
+    delete node;
+}
+
+// put node in place of the instruction after prev
+static void replace(AssemblyNode *prev, AssemblyNode *node) {
+    node->next = prev->next->next;
+    prev->next->next = nullptr;
+    delete prev->next;
+    prev->next = node;
+}
+
+// whether the value of reg is overwritten or dropped before anything after from reads it, as far as the basic
+// block shows; temp registers never live across a call, and only a0 and the saved registers across a return
+static bool isDead(AssemblyNode *from, int reg) {
+    for (AssemblyNode *cur = from; cur != nullptr; cur = cur->next) {
+        if (contains(cur->uses(), reg)) {
+            return false;
+        }
+        if (typeid(*cur) == typeid(Ret)) {
+            return std::find(TEMP_REGISTERS.begin(), TEMP_REGISTERS.end(), reg) != TEMP_REGISTERS.end() ||
+                   std::find(ARG_REGISTERS.begin() + 1, ARG_REGISTERS.end(), reg) != ARG_REGISTERS.end();
+        }
+        if (typeid(*cur) == typeid(CallAssembly)) {
+            return std::find(TEMP_REGISTERS.begin(), TEMP_REGISTERS.end(), reg) != TEMP_REGISTERS.end();
+        }
+        if (cur->kind() == "barrier" || cur->kind() == "branch") {
+            return false;
+        }
+        if (contains(cur->defs(), reg)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool isAddImm(AssemblyNode *node) {
+    return typeid(*node) == typeid(BinaryImmAssembly) && static_cast<BinaryImmAssembly *>(node)->getOp() == "+";
+}
+
+// mv x, x
+static bool selfMove(AssemblyNode *prev) {
+    auto mv = dynamic_cast<Mv *>(prev->next);
+    if (mv == nullptr || mv->getLhs() != mv->getRhs()) {
+        return false;
+    }
+    erase(prev);
+    return true;
+}
+
+// addi x, x, 0
+static bool addZero(AssemblyNode *prev) {
+    if (!isAddImm(prev->next)) {
+        return false;
+    }
+    auto addi = static_cast<BinaryImmAssembly *>(prev->next);
+    if (addi->getLhs() != addi->getRhs() || addi->getImm() != 0) {
+        return false;
+    }
+    erase(prev);
+    return true;
+}
+
+// addi x, x, a; addi x, x, b => addi x, x, a + b, such as two stack pointer adjustments
+static bool addAdd(AssemblyNode *prev) {
+    auto nodes = window(prev, 2);
+    if (nodes.size() < 2 || !isAddImm(nodes[0]) || !isAddImm(nodes[1])) {
+        return false;
+    }
+    auto first = static_cast<BinaryImmAssembly *>(nodes[0]), second = static_cast<BinaryImmAssembly *>(nodes[1]);
+    long long sum = static_cast<long long>(first->getImm()) + second->getImm();
+    if (first->getLhs() != first->getRhs() || second->getLhs() != first->getLhs() ||
+        second->getRhs() != first->getLhs() || !isImm12(sum)) {
+        return false;
+    }
+    replace(prev, new BinaryImmAssembly(Register(first->getLhs()), Register(first->getLhs()),
+                                        ImmAssembly(sum), "+"));
+    erase(prev->next);
+    return true;
+}
+
+// sw r, o(b); ...; lw d, o(b) => sw r, o(b); ...; mv d, r, nothing in between writing r, b or memory
+static bool storeLoad(AssemblyNode *prev) {
+    auto nodes = window(prev, 4);
+    auto sw = nodes.empty() ? nullptr : dynamic_cast<Sw *>(nodes[0]);
+    if (sw == nullptr) {
+        return false;
+    }
+    for (auto i = 1ull; i < nodes.size(); ++i) {
+        auto lw = dynamic_cast<Lw *>(nodes[i]);
+        if (lw != nullptr && lw->getBase() == sw->getBase() && lw->getOffset() == sw->getOffset()) {
+            if (lw->getReg() == sw->getReg()) {
+                erase(nodes[i - 1]);
+            } else {
+                replace(nodes[i - 1], new Mv(Register(lw->getReg()), Register(sw->getReg())));
+            }
+            return true;
+        }
+        std::string kind = nodes[i]->kind();
+        if ((kind != "alu" && kind != "load" && kind != "mul" && kind != "div") ||
+            contains(nodes[i]->defs(), sw->getReg()) || contains(nodes[i]->defs(), sw->getBase())) {
+            return false;
+        }
+    }
+    return false;
+}
+
+// j l; l: => l:
+static bool jumpNext(AssemblyNode *prev) {
+    auto j = dynamic_cast<J *>(prev->next);
+    if (j == nullptr) {
+        return false;
+    }
+    for (AssemblyNode *cur = j->next; cur != nullptr && typeid(*cur) == typeid(LabelAssembly); cur = cur->next) {
+        if (static_cast<LabelAssembly *>(cur)->getLabel() == j->getLabel()) {
+            erase(prev);
+            return true;
+        }
+    }
+    return false;
+}
+
+// li t, c; add d, a, t => addi d, a, c and li t, c; sub d, a, t => addi d, a, -c, t dead afterwards
+static bool loadImmAdd(AssemblyNode *prev) {
+    auto nodes = window(prev, 2);
+    if (nodes.size() < 2 || typeid(*nodes[0]) != typeid(Li) || typeid(*nodes[1]) != typeid(BinaryAssembly)) {
+        return false;
+    }
+    auto li = static_cast<Li *>(nodes[0]);
+    auto op = static_cast<BinaryAssembly *>(nodes[1]);
+    int t = li->getLhs(), d = op->defs()[0], a = op->uses()[0], b = op->uses()[1];
+    long long imm = li->getImm();
+    if (op->getOp() == "+" && a == t && b != t) {
+        std::swap(a, b);
+    } else if (op->getOp() == "-" && a != t && b == t) {
+        imm = -imm;
+    } else if (op->getOp() != "+" || a == t || b != t) {
+        return false;
+    }
+    if (!isImm12(imm) || (d != t && !isDead(op->next, t))) {
+        return false;
+    }
+    erase(prev);
+    replace(prev, new BinaryImmAssembly(Register(d), Register(a), ImmAssembly(imm), "+"));
+    return true;
+}
+
+// op x, ...; mv y, x => op y, ..., x dead afterwards
+static bool moveResult(AssemblyNode *prev) {
+    auto nodes = window(prev, 2);
+    if (nodes.size() < 2 || typeid(*nodes[1]) != typeid(Mv)) {
+        return false;
+    }
+    std::string kind = nodes[0]->kind();
+    auto mv = static_cast<Mv *>(nodes[1]);
+    if ((kind != "alu" && kind != "load" && kind != "mul" && kind != "div") || nodes[0]->defs().size() != 1 ||
+        nodes[0]->defs()[0] != mv->getRhs() || mv->getLhs() == mv->getRhs() || !isDead(mv->next, mv->getRhs())) {
+        return false;
+    }
+    nodes[0]->renameDef(mv->getLhs());
+    erase(nodes[0]);
+    return true;
+}
+
+struct PeepholeRule {
+    std::string name;
+    int window;  // instructions the rule looks at, starting with the one after its argument
+    bool (*rewrite)(AssemblyNode *prev);
+    int hits;
+};
+
+static std::vector<PeepholeRule> rules = {
+    {"mv x, x", 1, selfMove, 0},
+    {"addi x, x, 0", 1, addZero, 0},
+    {"addi x, x, a; addi x, x, b", 2, addAdd, 0},
+    {"sw r, o(b); lw d, o(b)", 4, storeLoad, 0},
+    {"j l; l:", 2, jumpNext, 0},
+    {"li t, c; add d, a, t", 2, loadImmAdd, 0},
+    {"op x, ...; mv y, x", 2, moveResult, 0},
+};
+
+void peephole(AssemblyNode *head) {
+    int width = 1;
+    for (auto &rule : rules) {
+        width = std::max(width, rule.window);
+    }
+    // slide over the list, stepping back after a rewrite so that the rules see the instructions it made
+    std::vector<AssemblyNode *> visited;
+    AssemblyNode *prev = head;
+    while (prev != nullptr) {
+        bool rewritten = false;
+        for (auto &rule : rules) {
+            if (prev->next != nullptr && rule.rewrite(prev)) {
+                ++rule.hits;
+                rewritten = true;
+                break;
+            }
+        }
+        if (!rewritten) {
+            visited.push_back(prev);
+            prev = prev->next;
+        } else if (!visited.empty()) {
+            int back = std::min<int>(width - 1, visited.size());
+            prev = visited[visited.size() - back];
+            visited.resize(visited.size() - back);
+        }
+    }
+}
+
+std::vector<std::pair<std::string, int>> peepholeHits() {
+    std::vector<std::pair<std::string, int>> hits;
+    for (auto &rule : rules) {
+        hits.emplace_back(rule.name, rule.hits);
+    }
+    return hits;
+}
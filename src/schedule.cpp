@@ -0,0 +1,170 @@
+#include "assembly.h"
+#include <cstdlib>
+#include <sstream>
+
+std::unordered_map<std::string, int> latencies = {
+    {"alu", 1}, {"load", 2}, {"store", 1}, {"mul", 3}, {"div", 34}, {"branch", 1}};
+
+bool setLatencies(const std::string &list) {
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        auto equal = item.find('=');
+        if (equal == std::string::npos || latencies.find(item.substr(0, equal)) == latencies.end()) {
+            return false;
+        }
+        char *end = nullptr;
+        long cycles = strtol(item.c_str() + equal + 1, &end, 10);
+        if (*end != '\0' || end == item.c_str() + equal + 1 || cycles < 1) {
+            return false;
+        }
+        latencies[item.substr(0, equal)] = cycles;
+    }
+    return true;
+}
+
+// list scheduling of the instructions of one basic block, a branch at the end stays there
+static std::vector<AssemblyNode *> scheduleBlock(std::vector<AssemblyNode *> &block) {
+    int n = block.size();
+    // dependences: predecessor -> cycles the successor waits after it
+    std::vector<std::vector<std::pair<int, int>>> succ(n);
+    std::vector<int> predCount(n, 0);
+    auto depend = [&](int from, int to, int latency) {
+        succ[from].emplace_back(to, latency);
+        ++predCount[to];
+    };
+    std::unordered_map<int, int> lastDef, version;
+    std::unordered_map<int, std::vector<int>> readers;
+    // memory accesses so far: index, whether it is a store, base register, its version, offset
+    struct Access {
+        int index;
+        bool store;
+        int base, version, offset;
+    };
+    std::vector<Access> accesses;
+    for (int i = 0; i < n; ++i) {
+        AssemblyNode *node = block[i];
+        bool branch = node->kind() == "branch";
+        for (int reg : node->uses()) {
+            auto it = lastDef.find(reg);
+            if (reg != 0 && it != lastDef.end()) {
+                int latency = latencies[block[it->second]->kind()];
+                depend(it->second, i, branch ? latency + latencies["branch"] - 1 : latency);
+            }
+            readers[reg].push_back(i);
+        }
+        if (node->kind() == "load" || node->kind() == "store") {
+            // word accesses off the same base value at different offsets are to different words
+            bool store = node->kind() == "store";
+            int base = store ? static_cast<Sw *>(node)->getBase() : static_cast<Lw *>(node)->getBase();
+            int offset = store ? static_cast<Sw *>(node)->getOffset() : static_cast<Lw *>(node)->getOffset();
+            for (auto &access : accesses) {
+                bool disjoint = access.base == base && access.version == version[base] && access.offset != offset;
+                if ((store || access.store) && !disjoint) {
+                    depend(access.index, i, access.store ? latencies["store"] : 0);
+                }
+            }
+            accesses.push_back({i, store, base, version[base], offset});
+        }
+        for (int reg : node->defs()) {
+            if (reg == 0) {
+                continue;
+            }
+            if (lastDef.find(reg) != lastDef.end()) {
+                depend(lastDef[reg], i, 1);
+            }
+            for (int reader : readers[reg]) {
+                if (reader != i) {
+                    depend(reader, i, 0);
+                }
+            }
+            readers[reg].clear();
+            lastDef[reg] = i;
+            ++version[reg];
+        }
+        // the branch ends the block
+        if (branch) {
+            for (int j = 0; j < i; ++j) {
+                depend(j, i, 0);
+            }
+        }
+    }
+
+    // longest latency path from each instruction to the end of the block
+    std::vector<int> height(n, 1);
+    for (int i = n - 1; i >= 0; --i) {
+        for (auto &edge : succ[i]) {
+            height[i] = std::max(height[i], edge.second + height[edge.first]);
+        }
+    }
+    // each cycle issue the ready instruction on the longest path, or wait for the one ready first
+    std::vector<int> earliest(n, 0);
+    std::vector<AssemblyNode *> order;
+    std::vector<int> ready;
+    for (int i = 0; i < n; ++i) {
+        if (predCount[i] == 0) {
+            ready.push_back(i);
+        }
+    }
+    int cycle = 0;
+    while (!ready.empty()) {
+        auto best = ready.begin();
+        for (auto it = ready.begin(); it != ready.end(); ++it) {
+            bool issuable = earliest[*it] <= cycle, bestIssuable = earliest[*best] <= cycle;
+            if (issuable != bestIssuable) {
+                best = issuable ? it : best;
+            } else if (!issuable && earliest[*it] != earliest[*best]) {
+                best = earliest[*it] < earliest[*best] ? it : best;
+            } else if (height[*it] != height[*best]) {
+                best = height[*it] > height[*best] ? it : best;
+            } else if (*it < *best) {
+                best = it;
+            }
+        }
+        int i = *best;
+        ready.erase(best);
+        cycle = std::max(cycle, earliest[i]);
+        order.push_back(block[i]);
+        for (auto &edge : succ[i]) {
+            earliest[edge.first] = std::max(earliest[edge.first], cycle + edge.second);
+            if (--predCount[edge.first] == 0) {
+                ready.push_back(edge.first);
+            }
+        }
+        ++cycle;
+    }
+    return order;
+}
+
+void scheduleBlocks(AssemblyNode *head, AssemblyNode *&tail) {
+    AssemblyNode *prev = head;
+    while (prev != tail) {
+        // the block after prev: instructions up to a barrier, and a branch ending it
+        std::vector<AssemblyNode *> block;
+        AssemblyNode *cur = prev->next;
+        while (cur != nullptr && cur->kind() != "barrier") {
+            block.push_back(cur);
+            if (cur->kind() == "branch" || cur == tail) {
+                break;
+            }
+            cur = cur->next;
+        }
+        if (block.empty()) {
+            prev = prev->next;
+            continue;
+        }
+        AssemblyNode *after = block.back()->next;
+        bool last = block.back() == tail;
+        if (block.size() > 1) {
+            block = scheduleBlock(block);
+        }
+        for (auto node : block) {
+            prev->next = node;
+            prev = node;
+        }
+        prev->next = after;
+        if (last) {
+            tail = prev;
+        }
+    }
+}
@@ -151,25 +151,9 @@ void CompUnit::translateStmt(SymbolTable* table, IRNode*& tail) {
 3, 4, {5}}, 内层的初始化列表 {5} 对应的数组是 int[3][4]. 对于 int[2][3][4] 和初始化列表 {{5}}, 内层的初始化列表 {5}
 之前没出现任何整数元素, 这种情况其对应的数组是 int[3][4].
 */
-static void translateArrayInitlist(std::vector<int>& size, int l, int r, InitVal* init, std::string initPlace,
-                                   std::string numPlace, SymbolTable* table, IRNode*& tail) {
-    int totalSize = 1;
-    for (int i = l; i <= r; ++i) {
-        totalSize *= size[i];
-    }
+static void translateArrayInitlist(std::vector<int>& size, int l, int r, InitVal* init, int base,
+                                   std::vector<std::pair<int, Exp*>>& elements) {
     if (!init->getVal()) {
-        if (!initPlace.empty()) {
-            linkToTail(tail, new LoadImm(Identifier(numPlace), Immediate(0)));
-        }
-        for (int i = 0; i < totalSize; ++i) {
-            if (initPlace.empty()) {
-                linkToTail(tail, new Word(Immediate(0)));
-            } else {
-                linkToTail(tail, new Store(Identifier(initPlace), Identifier(numPlace)));
-                linkToTail(tail,
-                           new BinopImm(Identifier(initPlace), Identifier(initPlace), Immediate(SIZE_OF_INT), "+"));
-            }
-        }
         return;
     }
 
@@ -181,7 +165,7 @@ static void translateArrayInitlist(std::vector<int>& size, int l, int r, InitVal
                 --edge;
             }
 
-            translateArrayInitlist(size, edge + 1, r, val, initPlace, numPlace, table, tail);
+            translateArrayInitlist(size, edge + 1, r, val, base + finishedNum, elements);
 
             int mul = 1;
             for (int i = edge + 1; i <= r; ++i) {
@@ -189,30 +173,133 @@ static void translateArrayInitlist(std::vector<int>& size, int l, int r, InitVal
             }
             finishedNum += mul;
         } else {
-            if (initPlace.empty()) {
-                linkToTail(tail, new Word(Immediate(static_cast<IntConst*>(val->getVal())->getValue())));
-            } else {
-                val->getVal()->translateExp(table, numPlace, false, tail);
-                linkToTail(tail, new Store(Identifier(initPlace), Identifier(numPlace)));
-                linkToTail(tail,
-                           new BinopImm(Identifier(initPlace), Identifier(initPlace), Immediate(SIZE_OF_INT), "+"));
-            }
+            elements.emplace_back(base + finishedNum, val->getVal());
             ++finishedNum;
         }
     }
+}
 
-    // fill the rest with 0
-    if (!initPlace.empty() && finishedNum < totalSize) {
-        linkToTail(tail, new LoadImm(Identifier(numPlace), Immediate(0)));
+// place = place + offset, the offset may not fit in an immediate
+static void advancePointer(std::string place, int offset, SymbolTable* table, IRNode*& tail) {
+    if (offset < 2048) {
+        linkToTail(tail, new BinopImm(Identifier(place), Identifier(place), Immediate(offset), "+"));
+    } else {
+        std::string offsetPlace = table->newTemp();
+        linkToTail(tail, new LoadImm(Identifier(offsetPlace), Immediate(offset)));
+        linkToTail(tail, new Binop(Identifier(place), Identifier(place), Identifier(offsetPlace), "+"));
     }
-    for (int i = finishedNum; i < totalSize; ++i) {
-        if (initPlace.empty()) {
-            linkToTail(tail, new Word(Immediate(0)));
+}
+
+const int ZERO_FILL_UNROLL = 4;
+
+// fill the whole array with 0 by a loop storing ZERO_FILL_UNROLL elements per iteration
+static void translateZeroFill(std::string name, int totalSize, SymbolTable* table, IRNode*& tail) {
+    std::string ptrPlace = table->newTemp(), endPlace = table->newTemp(), zeroPlace = table->newTemp();
+    std::string loopLabel = table->newLabel();
+    linkToTail(tail, new Assign(Identifier(ptrPlace), Identifier(name)));
+    linkToTail(tail, new LoadImm(Identifier(zeroPlace), Immediate(0)));
+    for (int i = 0; i < totalSize % ZERO_FILL_UNROLL; ++i) {
+        linkToTail(tail, new Store(Identifier(ptrPlace), Identifier(zeroPlace)));
+        linkToTail(tail, new BinopImm(Identifier(ptrPlace), Identifier(ptrPlace), Immediate(SIZE_OF_INT), "+"));
+    }
+    linkToTail(tail, new LoadImm(Identifier(endPlace), Immediate(totalSize / ZERO_FILL_UNROLL * ZERO_FILL_UNROLL * SIZE_OF_INT)));
+    linkToTail(tail, new Binop(Identifier(endPlace), Identifier(ptrPlace), Identifier(endPlace), "+"));
+    linkToTail(tail, new Label(loopLabel));
+    for (int i = 0; i < ZERO_FILL_UNROLL; ++i) {
+        linkToTail(tail, new Store(Identifier(ptrPlace), Identifier(zeroPlace)));
+        linkToTail(tail, new BinopImm(Identifier(ptrPlace), Identifier(ptrPlace), Immediate(SIZE_OF_INT), "+"));
+    }
+    linkToTail(tail, new CondGoto(Identifier(ptrPlace), Identifier(endPlace), "!=", loopLabel));
+}
+
+/*
+局部数组的初始化: 元素较少时逐个写入 (包括 0), 否则先用循环整体清零, 再只写入显式给出的非 0 元素,
+这样代码长度和初始化时间只与显式元素的个数有关.
+*/
+static void translateLocalArrayInit(std::string name, int totalSize, std::vector<std::pair<int, Exp*>>& elements,
+                                    SymbolTable* table, IRNode*& tail) {
+    bool zeroFill = elements.size() < static_cast<size_t>(totalSize) && totalSize > 2 * ZERO_FILL_UNROLL;
+    if (zeroFill) {
+        translateZeroFill(name, totalSize, table, tail);
+    }
+
+    std::string initPlace = table->newTemp(), zeroPlace = "";
+    linkToTail(tail, new Assign(Identifier(initPlace), Identifier(name)));
+    int current = 0;  // the element initPlace points to
+    auto store = [&](int index, std::string numPlace) {
+        if (index != current) {
+            advancePointer(initPlace, (index - current) * SIZE_OF_INT, table, tail);
+            current = index;
+        }
+        linkToTail(tail, new Store(Identifier(initPlace), Identifier(numPlace)));
+    };
+    auto storeZero = [&](int index) {
+        if (zeroPlace.empty()) {
+            zeroPlace = table->newTemp();
+            linkToTail(tail, new LoadImm(Identifier(zeroPlace), Immediate(0)));
+        }
+        store(index, zeroPlace);
+    };
+
+    int index = 0;
+    for (auto& element : elements) {
+        if (!zeroFill) {
+            for (; index < element.first; ++index) {
+                storeZero(index);
+            }
+        }
+        index = element.first + 1;
+        if (zeroFill && typeid(*element.second) == typeid(IntConst) &&
+            static_cast<IntConst*>(element.second)->getValue() == 0) {
+            continue;
+        }
+        std::string numPlace = table->newTemp();
+        element.second->translateExp(table, numPlace, false, tail);
+        store(element.first, numPlace);
+    }
+    if (!zeroFill) {
+        for (; index < totalSize; ++index) {
+            storeZero(index);
+        }
+    }
+}
+
+// global data: runs of zero become one Zero node, the other elements are packed into Word nodes
+static void translateGlobalArrayInit(int totalSize, std::vector<std::pair<int, Exp*>>& elements, IRNode*& tail) {
+    std::vector<int> values;
+    int zeros = 0;
+    auto addZeros = [&](int count) {
+        if (count && !values.empty()) {
+            linkToTail(tail, new Word(values));
+            values.clear();
+        }
+        zeros += count;
+    };
+    auto addValue = [&](int value) {
+        if (zeros) {
+            linkToTail(tail, new Zero(Immediate(zeros * SIZE_OF_INT)));
+            zeros = 0;
+        }
+        values.push_back(value);
+    };
+
+    int index = 0;
+    for (auto& element : elements) {
+        addZeros(element.first - index);
+        index = element.first + 1;
+        int value = static_cast<IntConst*>(element.second)->getValue();
+        if (value) {
+            addValue(value);
         } else {
-            linkToTail(tail, new Store(Identifier(initPlace), Identifier(numPlace)));
-            linkToTail(tail, new BinopImm(Identifier(initPlace), Identifier(initPlace), Immediate(SIZE_OF_INT), "+"));
+            addZeros(1);
         }
     }
+    addZeros(totalSize - index);
+    if (!values.empty()) {
+        linkToTail(tail, new Word(values));
+    } else if (zeros) {
+        linkToTail(tail, new Zero(Immediate(zeros * SIZE_OF_INT)));
+    }
 }
 
 void VarDef::translateStmt(SymbolTable* table, IRNode*& tail) {
@@ -233,18 +320,16 @@ void VarDef::translateStmt(SymbolTable* table, IRNode*& tail) {
             linkToTail(tail, new VarDec(Identifier(name), Immediate(totalSize * SIZE_OF_INT)));
         }
         if (init_) {
-            std::string initPlace = "", zeroPlace = "";
-            if (!table->isGlobalLayer()) {
-                initPlace = table->newTemp();
-                zeroPlace = table->newTemp();
-                linkToTail(tail, new Assign(Identifier(initPlace), Identifier(name)));
+            std::vector<std::pair<int, Exp*>> elements;
+            translateArrayInitlist(size, 0, array_def_->getDims().size() - 1, init_, 0, elements);
+            if (table->isGlobalLayer()) {
+                translateGlobalArrayInit(totalSize, elements, tail);
+            } else {
+                translateLocalArrayInit(name, totalSize, elements, table, tail);
             }
-            translateArrayInitlist(size, 0, array_def_->getDims().size() - 1, init_, initPlace, zeroPlace, table, tail);
         } else {
             if (table->isGlobalLayer()) {
-                for (int i = 0; i < totalSize; ++i) {
-                    linkToTail(tail, new Word(Immediate(0)));
-                }
+                linkToTail(tail, new Zero(Immediate(totalSize * SIZE_OF_INT)));
             }
         }
     } else if (init_) {
@@ -451,9 +536,14 @@ void CallExp::translateExp(SymbolTable* table, std::string& place, bool ignoreRe
 
     std::string function = table->lookup(name_);
     if (params_) {
+        // evaluate all arguments before passing any of them, since an argument may contain a call
+        std::vector<std::string> paramPlaces;
         for (auto param : params_->getParams()) {
             std::string paramPlace = table->newTemp();
             param->translateExp(table, paramPlace, false, tail);
+            paramPlaces.emplace_back(paramPlace);
+        }
+        for (auto paramPlace : paramPlaces) {
             linkToTail(tail, new Arg(Identifier(paramPlace)));
         }
     }
@@ -496,6 +586,21 @@ void BinaryExp::translateExp(SymbolTable* table, std::string& place, bool ignore
     linkToTail(tail, new Binop(Identifier(place), Identifier(left), Identifier(right), op_));
 }
 
+// a comparison used as a value, e.g. the left operand of `a < b == c`
+void RelExp::translateExp(SymbolTable* table, std::string& place, bool ignoreReturn, IRNode*& tail) {
+    if (place.empty()) {
+        place = table->newTemp();
+    }
+
+    std::string left = "";
+    std::string right = "";
+    lhs_->translateExp(table, left, false, tail);
+    handlePointer(table, left, tail);
+    rhs_->translateExp(table, right, false, tail);
+    handlePointer(table, right, tail);
+    linkToTail(tail, new Binop(Identifier(place), Identifier(left), Identifier(right), op_));
+}
+
 void RelExp::translateCond(SymbolTable* table, std::string trueLabel, std::string falseLabel, IRNode*& tail) {
     std::string left = "";
     std::string right = "";
@@ -10,7 +10,10 @@ from dataclasses import dataclass
 
 TIMEOUT = 10
 IR_PATH = "./ir.py"
+IRSIM_PATH = None  # native IR interpreter used instead of ir.py when set, see --irsim
 VENUS_JAR = "./venus.jar"
+RVSIM_PATH = None  # native RISC-V simulator used instead of Venus when set, see --rvsim
+COMPILER_FLAGS = []  # extra options passed to the compiler, see --flags
 PYTHON_PATH = sys.executable  # always use the current python
 JAVA_PATH = "java"
 TEST_PATH = "./.test"
@@ -111,16 +114,21 @@ def run_one_test(compiler: str, test: Test, lab: str, local: bool) -> TestResult
             ir_file_name = test.filename.replace(
                 ".sy", ".ll").split("/")[-1]
             ir_file_name = f"{TEST_PATH}/{ir_file_name}"
-        assert os.path.exists(IR_PATH), f"Error: {IR_PATH} not found."
+        if IRSIM_PATH is None:
+            assert os.path.exists(IR_PATH), f"Error: {IR_PATH} not found."
+            command = [PYTHON_PATH, IR_PATH, "-t", ir_file_name]
+        else:
+            assert os.path.exists(IRSIM_PATH), f"Error: {IRSIM_PATH} not found."
+            command = [IRSIM_PATH, "-t", ir_file_name]
         assert test.expected is not None, f"Error: {test.filename} has no expected output."
         try:
             result = subprocess.run(
-                [compiler, test.filename, ir_file_name],
+                [compiler, *COMPILER_FLAGS, test.filename, ir_file_name],
                 capture_output=True,
                 timeout=TIMEOUT)
             if result.returncode != 0:  # compile error
                 return TestResult(test, None, result.returncode)
-            with subprocess.Popen([PYTHON_PATH, IR_PATH, "-t", ir_file_name],
+            with subprocess.Popen(command,
                                   stdin=subprocess.PIPE,
                                   stdout=subprocess.PIPE,
                                   text=True) as p:
@@ -148,16 +156,21 @@ def run_one_test(compiler: str, test: Test, lab: str, local: bool) -> TestResult
             assembly_file_name = test.filename.replace(
                 ".sy", ".s").split("/")[-1]
             assembly_file_name = f"{TEST_PATH}/{assembly_file_name}"
-        assert os.path.exists(VENUS_JAR), f"Error: {VENUS_JAR} not found."
+        if RVSIM_PATH is None:
+            assert os.path.exists(VENUS_JAR), f"Error: {VENUS_JAR} not found."
+            command = [JAVA_PATH, "-jar", VENUS_JAR, assembly_file_name, "-ahs"]
+        else:
+            assert os.path.exists(RVSIM_PATH), f"Error: {RVSIM_PATH} not found."
+            command = [RVSIM_PATH, assembly_file_name]
         assert test.expected is not None, f"Error: {test.filename} has no expected output."
         try:
             result = subprocess.run(
-                [compiler, test.filename, assembly_file_name],
+                [compiler, *COMPILER_FLAGS, test.filename, assembly_file_name],
                 capture_output=True,
                 timeout=TIMEOUT)
             if result.returncode != 0:  # compile error
                 return TestResult(test, None, result.returncode)
-            with subprocess.Popen([JAVA_PATH, "-jar", VENUS_JAR, assembly_file_name, "-ahs"],
+            with subprocess.Popen(command,
                                   stdin=subprocess.PIPE,
                                   stdout=subprocess.PIPE,
                                   text=True) as p:
@@ -215,8 +228,16 @@ if __name__ == "__main__":
                         choices=["lab1", "lab2", "lab3", "lab4"])
     parser.add_argument("-l", "--local", action="store_true",
                         help="Generate temporary files locally.")
+    parser.add_argument("--irsim", type=str, metavar="PATH",
+                        help="Run lab3 IR with the native interpreter at PATH instead of ir.py.")
+    parser.add_argument("--rvsim", type=str, metavar="PATH",
+                        help="Run lab4 assembly with the native simulator at PATH instead of Venus.")
+    parser.add_argument("--flags", type=str, default="",
+                        help="Extra options passed to the compiler in lab3 and lab4, e.g. \"--regalloc=graph\".")
     args = parser.parse_args()
     input_file, lab, local = args.input_file, args.lab, args.local
+    IRSIM_PATH, RVSIM_PATH = args.irsim, args.rvsim
+    COMPILER_FLAGS = args.flags.split()
     if local:
         if not os.path.exists(TEST_PATH):
             os.mkdir(TEST_PATH)
@@ -0,0 +1,81 @@
+#include "ir.h"
+#include <string.h>
+
+FILE *outputFile, *immediateFile;
+
+// the IR nodes of each function and how often they ran, to stderr
+static void report(IRNode *root) {
+    fprintf(stderr, "%-24s %12s %16s\n", "function", "calls", "instructions");
+    for (IRNode *cur = root->next; cur != nullptr; cur = cur->next) {
+        if (typeid(*cur) != typeid(FuncDefNode)) {
+            continue;
+        }
+        long long instructions = 0;
+        for (IRNode *node = cur->next; node != nullptr && typeid(*node) != typeid(FuncDefNode); node = node->next) {
+            if (typeid(*node) != typeid(Label)) {
+                instructions += node->count;
+            }
+        }
+        fprintf(stderr, "%-24s %12lld %16lld\n", static_cast<FuncDefNode *>(cur)->getName().c_str(), cur->count,
+                instructions);
+    }
+    fprintf(stderr, "\n");
+    immediateFile = stderr;
+    for (IRNode *cur = root->next; cur != nullptr; cur = cur->next) {
+        if (cur->count >= 0) {
+            fprintf(stderr, "%12lld ", cur->count);
+        } else {
+            fprintf(stderr, "%12s ", "");
+        }
+        cur->print();
+    }
+}
+
+int main(int argc, char **argv) {
+    bool test = false, profile = false;
+    const char *path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--test") == 0) {
+            test = true;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            profile = true;
+        } else if (!path && argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            path = nullptr;
+            break;
+        }
+    }
+    if (!path) {
+        fprintf(stderr, "Usage: %s [-t] [--profile] <IR file>\n", argv[0]);
+        return 1;
+    }
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return 1;
+    }
+    IRNode *root = nullptr;
+    int result;
+    try {
+        root = readIR(file);
+        result = interpretIR(root, stdin, stdout, profile);
+    } catch (const std::runtime_error &error) {
+        fflush(stdout);
+        fprintf(stderr, "%s\n", error.what());
+        fclose(file);
+        delete root;
+        return 1;
+    }
+    fclose(file);
+    // as ir.py, test mode only prints what the program writes
+    if (!test) {
+        printf("exit with code %d\n", result);
+    }
+    if (profile) {
+        fflush(stdout);
+        report(root);
+    }
+    delete root;
+    return 0;
+}
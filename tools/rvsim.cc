@@ -0,0 +1,460 @@
+// RV32IM simulator for the assembly the compiler prints: the instructions of src/assembly.cpp, the startup code
+// and data of common.h, and the read, write and exit ecalls of _minilib_start
+#include "common.h"
+#include <string.h>
+#include <climits>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum Opcode {
+    ADD, SUB, MUL, MULH, MULHU, DIV, DIVU, REM, REMU, SLL, SRL, SRA, SLT, SLTU, XOR, AND, OR,
+    ADDI, XORI, ANDI, ORI, SLTI, SLTIU, SLLI, SRLI, SRAI,
+    LUI, LI, LA, MV, NEG, NOT, SEQZ, SNEZ, SLTZ, SGTZ,
+    LW, SW,
+    BEQ, BNE, BLT, BGE, BGT, BLE, BLTU, BGEU, BEQZ, BNEZ, BLTZ, BGEZ, BGTZ, BLEZ,
+    J, CALL, RET, JR,
+    ECALL, NOP,
+};
+
+enum Class { ALU, MULTIPLY, DIVIDE, LOAD, STORE, BRANCH, JUMP, SYSTEM, NUM_CLASSES };
+const char *const CLASS_NAMES[NUM_CLASSES] = {"alu", "mul", "div", "load", "store", "branch", "jump", "ecall"};
+
+// operand layout of each mnemonic:
+// R rd, rs1, rs2    I rd, rs1, imm    S rd, imm (shift)    U rd, imm    P rd, rs1 (pseudo)    A rd, label
+// L rd, imm(rs1)    W rs2, imm(rs1)   B rs1, rs2, label    Z rs1, label    T label    X rs1    N nothing
+struct Format {
+    Opcode op;
+    char layout;
+    Class cls;
+};
+
+const std::unordered_map<std::string, Format> FORMATS = {
+    {"add", {ADD, 'R', ALU}},       {"sub", {SUB, 'R', ALU}},       {"mul", {MUL, 'R', MULTIPLY}},
+    {"mulh", {MULH, 'R', MULTIPLY}}, {"mulhu", {MULHU, 'R', MULTIPLY}}, {"div", {DIV, 'R', DIVIDE}},
+    {"divu", {DIVU, 'R', DIVIDE}},  {"rem", {REM, 'R', DIVIDE}},    {"remu", {REMU, 'R', DIVIDE}},
+    {"sll", {SLL, 'R', ALU}},       {"srl", {SRL, 'R', ALU}},       {"sra", {SRA, 'R', ALU}},
+    {"slt", {SLT, 'R', ALU}},       {"sltu", {SLTU, 'R', ALU}},     {"xor", {XOR, 'R', ALU}},
+    {"and", {AND, 'R', ALU}},       {"or", {OR, 'R', ALU}},         {"addi", {ADDI, 'I', ALU}},
+    {"xori", {XORI, 'I', ALU}},     {"andi", {ANDI, 'I', ALU}},     {"ori", {ORI, 'I', ALU}},
+    {"slti", {SLTI, 'I', ALU}},     {"sltiu", {SLTIU, 'I', ALU}},   {"slli", {SLLI, 'S', ALU}},
+    {"srli", {SRLI, 'S', ALU}},     {"srai", {SRAI, 'S', ALU}},     {"lui", {LUI, 'U', ALU}},
+    {"li", {LI, 'U', ALU}},         {"la", {LA, 'A', ALU}},         {"mv", {MV, 'P', ALU}},
+    {"neg", {NEG, 'P', ALU}},       {"not", {NOT, 'P', ALU}},       {"seqz", {SEQZ, 'P', ALU}},
+    {"snez", {SNEZ, 'P', ALU}},     {"sltz", {SLTZ, 'P', ALU}},     {"sgtz", {SGTZ, 'P', ALU}},
+    {"lw", {LW, 'L', LOAD}},        {"sw", {SW, 'W', STORE}},       {"beq", {BEQ, 'B', BRANCH}},
+    {"bne", {BNE, 'B', BRANCH}},    {"blt", {BLT, 'B', BRANCH}},    {"bge", {BGE, 'B', BRANCH}},
+    {"bgt", {BGT, 'B', BRANCH}},    {"ble", {BLE, 'B', BRANCH}},    {"bltu", {BLTU, 'B', BRANCH}},
+    {"bgeu", {BGEU, 'B', BRANCH}},  {"beqz", {BEQZ, 'Z', BRANCH}},  {"bnez", {BNEZ, 'Z', BRANCH}},
+    {"bltz", {BLTZ, 'Z', BRANCH}},  {"bgez", {BGEZ, 'Z', BRANCH}},  {"bgtz", {BGTZ, 'Z', BRANCH}},
+    {"blez", {BLEZ, 'Z', BRANCH}},  {"j", {J, 'T', JUMP}},          {"call", {CALL, 'T', JUMP}},
+    {"ret", {RET, 'N', JUMP}},      {"jr", {JR, 'X', JUMP}},        {"ecall", {ECALL, 'N', SYSTEM}},
+    {"nop", {NOP, 'N', ALU}},
+};
+
+// a simple in-order five-stage pipeline: one instruction a cycle, plus these stalls
+const int LOAD_USE_STALL = 1;  // the next instruction reads the register just loaded
+const int TAKEN_STALL = 2;     // branches are predicted not taken and resolved in EX, jumps likewise
+const int MULTIPLY_STALL = 2;  // three-cycle multiplier, not pipelined
+const int DIVIDE_STALL = 32;   // one quotient bit a cycle
+
+const uint32_t DATA_BASE = 0x10000000;  // where .data starts, as in Venus
+
+struct Insn {
+    Opcode op;
+    Class cls;
+    int rd = 0, rs1 = 0, rs2 = 0;  // registers written and read, 0 if none
+    int32_t imm = 0;               // immediate, or the address or index of the label
+    int stall = 0;                 // cycles the instruction itself takes beyond one
+    int line;
+};
+
+class Machine {
+   public:
+    void assemble(std::istream &in);
+    int run(FILE *input, FILE *output);
+    void report(FILE *file);
+
+   private:
+    [[noreturn]] void fail(int line, const std::string &message) {
+        throw std::runtime_error("line " + std::to_string(line) + ": " + message);
+    }
+    int reg(const std::string &name, int line);
+    long long number(const std::string &text, int line);
+    uint32_t &word(uint32_t address, int line);
+
+    std::vector<Insn> text;
+    std::vector<uint8_t> data;
+    std::unordered_map<std::string, uint32_t> labels;  // instruction index in .text, address in .data
+    long long counts[NUM_CLASSES] = {}, taken = 0, cycles = 0;
+};
+
+static std::string trim(const std::string &text) {
+    size_t begin = text.find_first_not_of(" \t\r"), end = text.find_last_not_of(" \t\r");
+    return begin == std::string::npos ? "" : text.substr(begin, end - begin + 1);
+}
+
+int Machine::reg(const std::string &name, int line) {
+    for (int i = 0; i < NUM_OF_REG; ++i) {
+        if (name == REGISTER_NAMES[i] || name == "x" + std::to_string(i)) {
+            return i;
+        }
+    }
+    if (name == "fp") {
+        return 8;
+    }
+    fail(line, "unknown register " + name);
+}
+
+long long Machine::number(const std::string &text, int line) {
+    char *end;
+    long long value = strtoll(text.c_str(), &end, 0);
+    if (text.empty() || *end != '\0') {
+        fail(line, "bad number " + text);
+    }
+    return value;
+}
+
+uint32_t &Machine::word(uint32_t address, int line) {
+    if (address < DATA_BASE || address - DATA_BASE + 4 > data.size() || address % 4 != 0) {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "0x%08x", address);
+        fail(line, std::string("bad address ") + buffer);
+    }
+    return *reinterpret_cast<uint32_t *>(&data[address - DATA_BASE]);
+}
+
+void Machine::assemble(std::istream &in) {
+    bool inData = false;
+    std::string source;
+    // labels may be used before they are defined
+    std::vector<std::pair<std::string, size_t>> words;    // .word operands and where they go
+    std::vector<std::pair<size_t, std::string>> targets;  // instructions and the labels they name
+    for (int line = 1; std::getline(in, source); ++line) {
+        source = trim(source.substr(0, source.find('#')));
+        size_t colon = source.find(':');
+        if (colon != std::string::npos && source.find_first_of(" \t(") > colon) {
+            labels[source.substr(0, colon)] = inData ? DATA_BASE + data.size() : text.size();
+            source = trim(source.substr(colon + 1));
+        }
+        if (source.empty()) {
+            continue;
+        }
+        size_t space = source.find_first_of(" \t");
+        std::string mnemonic = source.substr(0, space);
+        std::vector<std::string> operands;
+        if (space != std::string::npos) {
+            std::string rest = source.substr(space);
+            for (size_t begin = 0, end; begin <= rest.size(); begin = end + 1) {
+                end = std::min(rest.find(',', begin), rest.size());
+                operands.push_back(trim(rest.substr(begin, end - begin)));
+            }
+        }
+        auto expect = [&](size_t count) {
+            if (operands.size() != count) {
+                fail(line, mnemonic + " takes " + std::to_string(count) + " operands");
+            }
+        };
+
+        if (mnemonic == ".data" || mnemonic == ".text") {
+            inData = mnemonic == ".data";
+        } else if (mnemonic == ".globl" || mnemonic == ".global") {
+        } else if (mnemonic == ".align") {
+            expect(1);
+            size_t alignment = 1ull << number(operands[0], line);
+            if (inData) {
+                data.resize((data.size() + alignment - 1) / alignment * alignment);
+            }
+        } else if (mnemonic == ".word" && inData) {
+            for (auto &operand : operands) {
+                words.emplace_back(operand, data.size());
+                data.resize(data.size() + 4);
+            }
+        } else if ((mnemonic == ".space" || mnemonic == ".zero") && inData) {
+            expect(1);
+            data.resize(data.size() + number(operands[0], line));
+        } else if (inData) {
+            fail(line, "unknown data directive " + mnemonic);
+        } else {
+            auto format = FORMATS.find(mnemonic);
+            if (format == FORMATS.end()) {
+                fail(line, "unknown instruction " + mnemonic);
+            }
+            Insn insn;
+            insn.op = format->second.op;
+            insn.cls = format->second.cls;
+            insn.line = line;
+            auto imm = [&](const std::string &operand, long long low, long long high) {
+                long long value = number(operand, line);
+                if (value < low || value > high) {
+                    fail(line, "immediate " + operand + " out of range");
+                }
+                return static_cast<int32_t>(value);
+            };
+            // imm(rs1)
+            auto address = [&](const std::string &operand) {
+                size_t open = operand.find('('), close = operand.find(')');
+                if (open == std::string::npos || close != operand.size() - 1) {
+                    fail(line, "bad address " + operand);
+                }
+                insn.imm = open ? imm(trim(operand.substr(0, open)), -2048, 2047) : 0;
+                insn.rs1 = reg(trim(operand.substr(open + 1, close - open - 1)), line);
+            };
+            switch (format->second.layout) {
+                case 'R':
+                    expect(3);
+                    insn.rd = reg(operands[0], line), insn.rs1 = reg(operands[1], line);
+                    insn.rs2 = reg(operands[2], line);
+                    break;
+                case 'I':
+                    expect(3);
+                    insn.rd = reg(operands[0], line), insn.rs1 = reg(operands[1], line);
+                    insn.imm = imm(operands[2], -2048, 2047);
+                    break;
+                case 'S':
+                    expect(3);
+                    insn.rd = reg(operands[0], line), insn.rs1 = reg(operands[1], line);
+                    insn.imm = imm(operands[2], 0, 31);
+                    break;
+                case 'U':
+                    expect(2);
+                    insn.rd = reg(operands[0], line);
+                    insn.imm = insn.op == LUI ? imm(operands[1], 0, 0xfffff) : imm(operands[1], INT_MIN, UINT32_MAX);
+                    break;
+                case 'P':
+                    expect(2);
+                    insn.rd = reg(operands[0], line), insn.rs1 = reg(operands[1], line);
+                    break;
+                case 'A':
+                    expect(2);
+                    insn.rd = reg(operands[0], line);
+                    targets.emplace_back(text.size(), operands[1]);
+                    break;
+                case 'L':
+                    expect(2);
+                    insn.rd = reg(operands[0], line);
+                    address(operands[1]);
+                    break;
+                case 'W':
+                    expect(2);
+                    insn.rs2 = reg(operands[0], line);
+                    address(operands[1]);
+                    break;
+                case 'B':
+                    expect(3);
+                    insn.rs1 = reg(operands[0], line), insn.rs2 = reg(operands[1], line);
+                    targets.emplace_back(text.size(), operands[2]);
+                    break;
+                case 'Z':
+                    expect(2);
+                    insn.rs1 = reg(operands[0], line);
+                    targets.emplace_back(text.size(), operands[1]);
+                    break;
+                case 'T':
+                    expect(1);
+                    insn.rd = insn.op == CALL ? 1 : 0;
+                    targets.emplace_back(text.size(), operands[0]);
+                    break;
+                case 'X':
+                    expect(1);
+                    insn.rs1 = reg(operands[0], line);
+                    break;
+                default:
+                    expect(0);
+                    if (insn.op == RET) {
+                        insn.rs1 = 1;
+                    } else if (insn.op == ECALL) {
+                        insn.rs1 = 10, insn.rs2 = 11;
+                    }
+            }
+            insn.stall = insn.cls == MULTIPLY ? MULTIPLY_STALL : insn.cls == DIVIDE ? DIVIDE_STALL : 0;
+            text.push_back(insn);
+        }
+    }
+
+    for (auto &target : targets) {
+        auto it = labels.find(target.second);
+        if (it == labels.end()) {
+            fail(text[target.first].line, "undefined label " + target.second);
+        }
+        text[target.first].imm = it->second;
+    }
+    for (auto &item : words) {
+        auto it = labels.find(item.first);
+        uint32_t value = it != labels.end() ? it->second : number(item.first, 0);
+        *reinterpret_cast<uint32_t *>(&data[item.second]) = value;
+    }
+}
+
+int Machine::run(FILE *input, FILE *output) {
+    auto start = labels.find("_minilib_start");
+    if (start == labels.end()) {
+        throw std::runtime_error("no _minilib_start");
+    }
+    int32_t x[NUM_OF_REG] = {};
+    size_t pc = start->second;
+    int loaded = 0;  // register written by the last instruction if it was a load
+    for (;;) {
+        if (pc >= text.size()) {
+            throw std::runtime_error("jumped out of the program");
+        }
+        const Insn &insn = text[pc++];
+        ++counts[insn.cls];
+        cycles += 1 + insn.stall;
+        if (loaded != 0 && (insn.rs1 == loaded || insn.rs2 == loaded)) {
+            cycles += LOAD_USE_STALL;
+        }
+        loaded = 0;
+        int32_t a = x[insn.rs1], b = x[insn.rs2];
+        uint32_t ua = a, ub = b;
+        int32_t result = 0;
+        bool branch = false;
+        switch (insn.op) {
+            case ADD: result = ua + ub; break;
+            case SUB: result = ua - ub; break;
+            case MUL: result = ua * ub; break;
+            case MULH: result = (static_cast<int64_t>(a) * b) >> 32; break;
+            case MULHU: result = (static_cast<uint64_t>(ua) * ub) >> 32; break;
+            case DIV: result = b == 0 ? -1 : a == INT_MIN && b == -1 ? a : a / b; break;
+            case DIVU: result = ub == 0 ? -1 : ua / ub; break;
+            case REM: result = b == 0 ? a : a == INT_MIN && b == -1 ? 0 : a % b; break;
+            case REMU: result = ub == 0 ? a : ua % ub; break;
+            case SLL: result = ua << (b & 31); break;
+            case SRL: result = ua >> (b & 31); break;
+            case SRA: result = a >> (b & 31); break;
+            case SLT: result = a < b; break;
+            case SLTU: result = ua < ub; break;
+            case XOR: result = a ^ b; break;
+            case AND: result = a & b; break;
+            case OR: result = a | b; break;
+            case ADDI: result = ua + static_cast<uint32_t>(insn.imm); break;
+            case XORI: result = a ^ insn.imm; break;
+            case ANDI: result = a & insn.imm; break;
+            case ORI: result = a | insn.imm; break;
+            case SLTI: result = a < insn.imm; break;
+            case SLTIU: result = ua < static_cast<uint32_t>(insn.imm); break;
+            case SLLI: result = ua << insn.imm; break;
+            case SRLI: result = ua >> insn.imm; break;
+            case SRAI: result = a >> insn.imm; break;
+            case LUI: result = static_cast<uint32_t>(insn.imm) << 12; break;
+            case LI:
+            case LA: result = insn.imm; break;
+            case MV: result = a; break;
+            case NEG: result = 0u - ua; break;
+            case NOT: result = ~a; break;
+            case SEQZ: result = a == 0; break;
+            case SNEZ: result = a != 0; break;
+            case SLTZ: result = a < 0; break;
+            case SGTZ: result = a > 0; break;
+            case LW:
+                result = word(ua + insn.imm, insn.line);
+                loaded = insn.rd;
+                break;
+            case SW: word(ua + insn.imm, insn.line) = b; break;
+            case BEQ: branch = a == b; break;
+            case BNE: branch = a != b; break;
+            case BLT: branch = a < b; break;
+            case BGE: branch = a >= b; break;
+            case BGT: branch = a > b; break;
+            case BLE: branch = a <= b; break;
+            case BLTU: branch = ua < ub; break;
+            case BGEU: branch = ua >= ub; break;
+            case BEQZ: branch = a == 0; break;
+            case BNEZ: branch = a != 0; break;
+            case BLTZ: branch = a < 0; break;
+            case BGEZ: branch = a >= 0; break;
+            case BGTZ: branch = a > 0; break;
+            case BLEZ: branch = a <= 0; break;
+            case J: branch = true; break;
+            case CALL:
+                result = pc;
+                branch = true;
+                break;
+            case RET:
+            case JR:
+                pc = ua;
+                ++taken;
+                cycles += TAKEN_STALL;
+                break;
+            case ECALL:
+                if (a == 1) {
+                    fprintf(output, "%d", b);
+                } else if (a == 6) {
+                    if (fscanf(input, "%d", &x[10]) != 1) {
+                        fail(insn.line, "no input left for read");
+                    }
+                } else if (a == 11) {
+                    fputc(b, output);
+                } else if (a == 10 || a == 17) {
+                    fputc('\n', output);
+                    return a == 10 ? 0 : b;
+                } else {
+                    fail(insn.line, "unknown ecall " + std::to_string(a));
+                }
+                break;
+            case NOP: break;
+        }
+        if (branch) {
+            pc = insn.imm;
+            ++taken;
+            cycles += TAKEN_STALL;
+        }
+        x[insn.rd] = result;
+        x[0] = 0;
+    }
+}
+
+void Machine::report(FILE *file) {
+    long long total = 0;
+    for (long long count : counts) {
+        total += count;
+    }
+    fprintf(file, "%-12s %14lld\n", "instructions", total);
+    for (int i = 0; i < NUM_CLASSES; ++i) {
+        fprintf(file, "  %-10s %14lld %6.2f%%\n", CLASS_NAMES[i], counts[i], total ? 100.0 * counts[i] / total : 0.0);
+    }
+    fprintf(file, "%-12s %14lld of %lld branches and jumps\n", "taken", taken, counts[BRANCH] + counts[JUMP]);
+    fprintf(file, "%-12s %14lld %6.2f per instruction\n", "cycles", cycles, total ? 1.0 * cycles / total : 0.0);
+}
+
+int main(int argc, char **argv) {
+    bool stats = false;
+    const char *path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--stats") == 0) {
+            stats = true;
+        } else if (!path && argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            path = nullptr;
+            break;
+        }
+    }
+    if (!path) {
+        fprintf(stderr, "Usage: %s [--stats] <assembly file>\n", argv[0]);
+        return 1;
+    }
+    std::ifstream file(path);
+    if (!file) {
+        perror(path);
+        return 1;
+    }
+    Machine machine;
+    int result;
+    try {
+        machine.assemble(file);
+        result = machine.run(stdin, stdout);
+    } catch (const std::runtime_error &error) {
+        fflush(stdout);
+        fprintf(stderr, "%s\n", error.what());
+        return 1;
+    }
+    fflush(stdout);
+    if (stats) {
+        machine.report(stderr);
+    }
+    return result & 0xff;
+}